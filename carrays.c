@@ -2,6 +2,8 @@
 #include <stdlib.h> // drand48()
 #include <string.h>
 #include <assert.h>
+#include <math.h> // log(), exp(), log1p()
+#include <float.h> // DBL_MAX
 #include "carrays.h"
 
 //
@@ -21,21 +23,27 @@
 // http://en.wikipedia.org/wiki/Binary_GCD_algorithm
 uint32_t gca_calc_GCD(uint32_t a, uint32_t b)
 {
-  uint32_t shift;
+  return (uint32_t)gca_calc_GCD64(a, b);
+}
+
+// Binary GCD, stripping factors of two with count-trailing-zeros
+uint64_t gca_calc_GCD64(uint64_t a, uint64_t b)
+{
+  unsigned shift;
 
   if(a == 0) return b;
   if(b == 0) return a;
 
   // Find power of two divisor
-  for(shift = 0; ((a | b) & 1) == 0; shift++) { a >>= 1; b >>= 1; }
+  shift = __builtin_ctzll(a | b);
 
   // Remove remaining factors of two from a - they are not common
-  while((a & 1) == 0) a >>= 1;
+  a >>= __builtin_ctzll(a);
 
   do
   {
     // Remove remaining factors of two from b - they are not common
-    while((b & 1) == 0) b >>= 1;
+    b >>= __builtin_ctzll(b);
 
     if(a > b) { SWAP(a,b); }
     b = b - a;
@@ -45,16 +53,106 @@ uint32_t gca_calc_GCD(uint32_t a, uint32_t b)
   return a << shift;
 }
 
+// Swap two non-overlapping blocks of memory, a chunk at a time
+static inline void _gca_swap_blocks(char *a, char *b, size_t nbytes)
+{
+  char tmp[256];
+  size_t m;
+  for(; nbytes; nbytes -= m, a += m, b += m) {
+    m = nbytes < sizeof(tmp) ? nbytes : sizeof(tmp);
+    memcpy(tmp, a, m);
+    memcpy(a, b, m);
+    memcpy(b, tmp, m);
+  }
+}
+
+// Rotations below only work on 0 < shift < n
+
+// Copy the smaller side out, memmove the rest and copy it back
+// tmp must hold min(shift, n-shift) elements
+static inline void _gca_cycle_left_buf(char *ptr, size_t n, size_t es,
+                                       size_t shift, char *tmp)
+{
+  if(shift <= n - shift) {
+    memcpy(tmp, ptr, es*shift);
+    memmove(ptr, ptr+es*shift, es*(n-shift));
+    memcpy(ptr+es*(n-shift), tmp, es*shift);
+  } else {
+    memcpy(tmp, ptr+es*shift, es*(n-shift));
+    memmove(ptr+es*(n-shift), ptr, es*shift);
+    memcpy(ptr, tmp, es*(n-shift));
+  }
+}
+
+// Rotate by swapping blocks (Gries-Mills). Swaps the shorter side into its
+// final place with one sequential pass, then repeats on what remains.
+// Once the shorter side fits in tmp[0..tmpsize-1], finish by copying.
+static void _gca_cycle_left_swap(char *ptr, size_t n, size_t es, size_t shift,
+                                 char *tmp, size_t tmpsize)
+{
+  // blocks A = ptr[0,i) and B = ptr[i,i+j) still need swapping
+  size_t i = shift, j = n - shift;
+  while(i != j) {
+    if(es*(i < j ? i : j) <= tmpsize) {
+      _gca_cycle_left_buf(ptr, i+j, es, i, tmp);
+      return;
+    }
+    if(i > j) {
+      // A = A1 A2 with |A1| = j. Swap A1 and B to get B A2 A1, B is done
+      _gca_swap_blocks(ptr, ptr+es*i, es*j);
+      ptr += es*j;
+      i -= j;
+    } else {
+      // B = B1 B2 with |B2| = i. Swap A and B2 to get B2 B1 A, A is done
+      _gca_swap_blocks(ptr, ptr+es*j, es*i);
+      j -= i;
+    }
+  }
+  _gca_swap_blocks(ptr, ptr+es*i, es*i);
+}
+
+void gca_cycle_left_swap(void *_ptr, size_t n, size_t es, size_t shift)
+{
+  if(n <= 1 || !shift) return;
+  shift = shift % n;
+  if(shift) _gca_cycle_left_swap((char*)_ptr, n, es, shift, NULL, 0);
+}
+
+// Rotate with three reversals, two reads and writes per element
+void gca_cycle_left_reverse(void *_ptr, size_t n, size_t es, size_t shift)
+{
+  char *ptr = (char*)_ptr;
+  if(n <= 1 || !shift) return;
+  shift = shift % n;
+  if(!shift) return;
+  gca_reverse(ptr, shift, es);
+  gca_reverse(ptr+es*shift, n-shift, es);
+  gca_reverse(ptr, n, es);
+}
+
 // cyclic-shift an array by `shift` elements
 // cycle left shifts towards zero
+// Block swaps, which move memory sequentially, until the smaller side fits
+// in a small buffer, then copies through the buffer
 void gca_cycle_left(void *_ptr, size_t n, size_t es, size_t shift)
+{
+  char tmp[GCA_CYCLE_BUF];
+  if(n <= 1 || !shift) return; // cannot mod by zero
+  shift = shift % n; // shift cannot be greater than n
+  if(shift) _gca_cycle_left_swap((char*)_ptr, n, es, shift, tmp, sizeof(tmp));
+}
+
+// Rotate by following cycles of the permutation (GCD juggling). One read and
+// write per element, but each move jumps `shift` elements, so it is slow on
+// arrays that do not fit in cache.
+void gca_cycle_left_juggle(void *_ptr, size_t n, size_t es, size_t shift)
 {
   char *ptr = (char*)_ptr;
   if(n <= 1 || !shift) return; // cannot mod by zero
   shift = shift % n; // shift cannot be greater than n
 
   // Using GCD
-  size_t i, j, k, gcd = gca_calc_GCD(n, shift);
+  size_t i, j, k, gcd = gca_calc_GCD64(n, shift);
   char tmp[es];
 
   // i is initial starting position
@@ -80,11 +178,100 @@ void gca_cycle_right(void *_ptr, size_t n, size_t es, size_t shift)
   gca_cycle_left(_ptr, n, es, n - shift);
 }
 
+//
+// Reverse
+//
+// Kernels for 1/2/4/8/16 byte elements load a block from each end, reverse
+// the order of the elements within each block and store them at the opposite
+// end. Blocks are 16 byte vectors when the target has a byte shuffle
+// (SSSE3 / NEON), otherwise 64 bit words. Other sizes swap whole elements.
+//
+
+#if defined(__SSSE3__) || defined(__ARM_NEON)
+  #if defined(__clang__)
+    typedef uint8_t _gca_rblk_t __attribute__((vector_size(16)));
+    #define _gca_vrev(x,...) __builtin_shufflevector(x, x, __VA_ARGS__)
+  #elif defined(__GNUC__)
+    typedef uint8_t _gca_rblk_t __attribute__((vector_size(16)));
+    #define _gca_vrev(x,...) __builtin_shuffle(x, (_gca_rblk_t){__VA_ARGS__})
+  #endif
+#endif
+
+#ifdef _gca_vrev
+  #define _gca_rev1(x) _gca_vrev(x,15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0)
+  #define _gca_rev2(x) _gca_vrev(x,14,15,12,13,10,11,8,9,6,7,4,5,2,3,0,1)
+  #define _gca_rev4(x) _gca_vrev(x,12,13,14,15,8,9,10,11,4,5,6,7,0,1,2,3)
+  #define _gca_rev8(x) _gca_vrev(x,8,9,10,11,12,13,14,15,0,1,2,3,4,5,6,7)
+#else
+  typedef uint64_t _gca_rblk_t;
+  #define _gca_rev1(x) __builtin_bswap64(x)
+  #define _gca_rev2(x) _gca_rev4(((x) & 0xffff0000ffff0000ULL) >> 16 | \
+                                 ((x) & 0x0000ffff0000ffffULL) << 16)
+  #define _gca_rev4(x) ((x) >> 32 | (x) << 32)
+  #define _gca_rev8(x) (x)
+#endif
+#define _gca_rev16(x) (x)
+
+typedef struct { uint64_t w[2]; } _gca_rblk16_t;
+
+// Swap a[i] and b[n-1-i] one element at a time
+static inline void _gca_swap_reversed_elems(char *a, char *b, size_t n,
+                                            size_t es)
+{
+  char *bend = b + es*n;
+  for(; b < bend; a += es) {
+    bend -= es;
+    if(es <= 16) gca_swapm(a, bend, es);
+    else _gca_swap_blocks(a, bend, es);
+  }
+}
+
+#define reversefunc(fname,blk_t,rev)                                           \
+static void fname(char *a, char *b, size_t n, size_t es)                       \
+{                                                                              \
+  blk_t x, y;                                                                  \
+  size_t nbytes = es*n;                                                        \
+  char *bend = b + nbytes;                                                     \
+  for(; nbytes >= sizeof(blk_t); nbytes -= sizeof(blk_t)) {                    \
+    bend -= sizeof(blk_t);                                                     \
+    memcpy(&x, a, sizeof(blk_t));                                              \
+    memcpy(&y, bend, sizeof(blk_t));                                           \
+    x = rev(x);                                                                \
+    y = rev(y);                                                                \
+    memcpy(a, &y, sizeof(blk_t));                                              \
+    memcpy(bend, &x, sizeof(blk_t));                                           \
+    a += sizeof(blk_t);                                                        \
+  }                                                                            \
+  /* less than a block left: a[0..nbytes) and b[0..nbytes) */                  \
+  _gca_swap_reversed_elems(a, b, nbytes/es, es);                               \
+}
+
+reversefunc(_gca_swap_reversed1,  _gca_rblk_t,   _gca_rev1);
+reversefunc(_gca_swap_reversed2,  _gca_rblk_t,   _gca_rev2);
+reversefunc(_gca_swap_reversed4,  _gca_rblk_t,   _gca_rev4);
+reversefunc(_gca_swap_reversed8,  _gca_rblk_t,   _gca_rev8);
+reversefunc(_gca_swap_reversed16, _gca_rblk16_t, _gca_rev16);
+#undef reversefunc
+
+// Swap a[i] with b[n-1-i] for i < n. a[0..n-1] and b[0..n-1] must not overlap
+void gca_swap_reversed(void *a, void *b, size_t n, size_t es)
+{
+  switch(es) {
+    case 1:  _gca_swap_reversed1(a, b, n, es); break;
+    case 2:  _gca_swap_reversed2(a, b, n, es); break;
+    case 4:  _gca_swap_reversed4(a, b, n, es); break;
+    case 8:  _gca_swap_reversed8(a, b, n, es); break;
+    case 16: _gca_swap_reversed16(a, b, n, es); break;
+    default: _gca_swap_reversed_elems(a, b, n, es);
+  }
+}
+
 void gca_reverse(void *_ptr, size_t n, size_t es)
 {
   if(n <= 1 || !es) return;
-  char *a = (char*)_ptr, *b = a + es*(n-1);
-  for(; a < b; a += es, b -= es) gca_swapm(a, b, es);
+  char *ptr = (char*)_ptr;
+  // swap first half with second half, skipping the middle element if n is odd
+  gca_swap_reversed(ptr, ptr + es*(n - n/2), n/2, es);
 }
 
 // Shuffle entire array
@@ -106,6 +293,369 @@ void gca_sample(void *base, size_t n, size_t es, size_t m)
   }
 }
 
+void gca_rand_jump(GcaRand *r)
+{
+  static const uint64_t jump[] = {0x180ec6d33cfd0abaULL, 0xd5a61266f0c9392cULL,
+                                  0xa9582618e03fc9aaULL, 0x39abdc4529b1661cULL};
+  uint64_t s[4] = {0, 0, 0, 0};
+  int i, b, k;
+  for(i = 0; i < 4; i++) {
+    for(b = 0; b < 64; b++) {
+      if(jump[i] & (1ULL << b))
+        for(k = 0; k < 4; k++) s[k] ^= r->s[k];
+      gca_rand_next(r);
+    }
+  }
+  memcpy(r->s, s, sizeof(s));
+}
+
+// Swap two elements, with fixed size copies for common sizes
+#define _gca_swap_es(a,b,es) do {                                              \
+  switch(es) {                                                                 \
+    case 4: { uint32_t _x, _y; memcpy(&_x,a,4); memcpy(&_y,b,4);               \
+              memcpy(a,&_y,4); memcpy(b,&_x,4); break; }                       \
+    case 8: { uint64_t _x, _y; memcpy(&_x,a,8); memcpy(&_y,b,8);               \
+              memcpy(a,&_y,8); memcpy(b,&_x,8); break; }                       \
+    default: gca_swapm(a, b, es);                                              \
+  }                                                                            \
+} while(0)
+
+void gca_shuffle_r(void *base, size_t n, size_t es, GcaRand *r)
+{
+  gca_sample_r(base, n, es, n, r);
+}
+
+void gca_sample_r(void *base, size_t n, size_t es, size_t m, GcaRand *r)
+{
+  char *b = (char*)base;
+  size_t i, j;
+  if(m >= n) m = n ? n-1 : 0; // last element has nowhere to go
+  for(i = 0; i < m; i++) {
+    j = i + gca_rand_bounded(r, n-i);
+    _gca_swap_es(b+es*i, b+es*j, es);
+  }
+}
+
+//
+// Reservoir sampling, Vitter's Algorithm L
+// https://dl.acm.org/doi/10.1145/198429.198435
+//
+
+// Uniform random double in (0,1), so that log() is finite
+static inline double _gca_rand_open(GcaRand *r)
+{
+  return ((gca_rand_next(r) >> 11) + 0.5) * 0x1.0p-53;
+}
+
+// Pick the next element to enter the sample
+static void _gca_reservoir_skip(GcaReservoir *rs)
+{
+  double s;
+  rs->w *= exp(log(_gca_rand_open(rs->r)) / rs->m);
+  s = floor(log(_gca_rand_open(rs->r)) / log1p(-rs->w));
+  // skip is geometric, it may be larger than any stream
+  if(!(s < (double)(SIZE_MAX - rs->next))) rs->next = SIZE_MAX;
+  else rs->next += (size_t)s + 1;
+}
+
+void gca_reservoir_init(GcaReservoir *rs, void *buf, size_t es, size_t m,
+                        GcaRand *r)
+{
+  GcaReservoir tmp = {.b = (char*)buf, .es = es, .m = m, .n = 0,
+                      .next = SIZE_MAX, .w = 1, .r = r};
+  memcpy(rs, &tmp, sizeof(GcaReservoir));
+}
+
+void gca_reservoir_add_n(GcaReservoir *rs, const void *ptr, size_t n)
+{
+  const char *src = (const char*)ptr;
+  size_t start = rs->n, end = rs->n + n, es = rs->es;
+
+  // fill the sample with the first m elements
+  for(; rs->n < rs->m && rs->n < end; rs->n++)
+    memcpy(rs->b + es*rs->n, src + es*(rs->n - start), es);
+
+  // sample just filled up
+  if(start < rs->m && rs->n == rs->m) {
+    rs->next = rs->m - 1;
+    _gca_reservoir_skip(rs);
+  }
+
+  // then replace a random element with each element picked
+  while(rs->next < end) {
+    memcpy(rs->b + es*gca_rand_bounded(rs->r, rs->m),
+           src + es*(rs->next - start), es);
+    _gca_reservoir_skip(rs);
+  }
+  rs->n = end;
+}
+
+void gca_reservoir_add(GcaReservoir *rs, const void *ptr)
+{
+  gca_reservoir_add_n(rs, ptr, 1);
+}
+
+size_t gca_sample_copy(const void *base, size_t n, size_t es, size_t m,
+                       void *out, GcaRand *r)
+{
+  GcaReservoir rs;
+  gca_reservoir_init(&rs, out, es, m, r);
+  gca_reservoir_add_n(&rs, base, n);
+  return gca_reservoir_size(&rs);
+}
+
+// Add x to a hash set of indices, returns false if it was already there.
+// Set has size mask+1 (a power of two), empty slots are SIZE_MAX
+static inline bool _gca_idxset_add(size_t *set, size_t mask, size_t x)
+{
+  size_t i = (size_t)((x * 0x9e3779b97f4a7c15ULL) >> 16) & mask;
+  for(; set[i] != SIZE_MAX; i = (i+1) & mask)
+    if(set[i] == x) return false;
+  set[i] = x;
+  return true;
+}
+
+// Floyd's algorithm: for j = n-m..n-1 pick t in [0,j], take t unless it was
+// already taken, in which case take j (which cannot have been)
+void gca_sample_idx(size_t *idx, size_t n, size_t m, GcaRand *r)
+{
+  size_t i, j, k, t, mask = gca_roundup64(2*m) - 1, *set = NULL;
+  assert(m <= n);
+
+  // linear search is cheaper than a hash set for small m
+  if(m <= 32 || !(set = malloc((mask+1) * sizeof(size_t)))) {
+    for(i = 0, j = n-m; j < n; i++, j++) {
+      t = gca_rand_bounded(r, j+1);
+      for(k = 0; k < i; k++) if(idx[k] == t) { t = j; break; }
+      idx[i] = t;
+    }
+    return;
+  }
+
+  memset(set, 0xff, (mask+1) * sizeof(size_t));
+  for(i = 0, j = n-m; j < n; i++, j++) {
+    t = gca_rand_bounded(r, j+1);
+    if(!_gca_idxset_add(set, mask, t)) _gca_idxset_add(set, mask, t = j);
+    idx[i] = t;
+  }
+  free(set);
+}
+
+//
+// Weighted sampling
+//
+
+// Vose's alias method: http://www.keithschwarz.com/darts-dice-coins/
+bool gca_alias_alloc(GcaAlias *t, const double *w, size_t n)
+{
+  size_t i, s, l, nsmall = 0, nlarge = n, *work;
+  double sum = 0, *p;
+  GcaAliasCol *cols;
+
+  t->n = 0;
+  t->cols = NULL;
+  for(i = 0; i < n; i++) {
+    if(!(w[i] >= 0)) return false; // negative or NaN
+    sum += w[i];
+  }
+  if(!(sum > 0 && sum <= DBL_MAX)) return false;
+
+  cols = malloc(n * sizeof(GcaAliasCol));
+  p = malloc(n * sizeof(double));
+  work = malloc(n * sizeof(size_t));
+  if(!cols || !p || !work) { free(cols); free(p); free(work); return false; }
+
+  // columns below average go at the front of work, the rest at the back
+  for(i = 0; i < n; i++) {
+    p[i] = w[i] / sum * (double)n;
+    if(p[i] < 1) work[nsmall++] = i;
+    else work[--nlarge] = i;
+  }
+
+  // fill each small column up to 1 with a large one
+  while(nsmall && nlarge < n) {
+    s = work[--nsmall];
+    l = work[nlarge];
+    cols[s].thresh = (uint64_t)(p[s] * 0x1.0p53);
+    cols[s].alias = l;
+    p[l] -= 1 - p[s];
+    if(p[l] < 1) { nlarge++; work[nsmall++] = l; }
+  }
+
+  // what remains is 1 up to rounding error
+  while(nsmall) work[--nlarge] = work[--nsmall];
+  for(i = nlarge; i < n; i++) {
+    cols[work[i]].thresh = UINT64_C(1) << 53;
+    cols[work[i]].alias = work[i];
+  }
+
+  free(p);
+  free(work);
+  t->n = n;
+  t->cols = cols;
+  return true;
+}
+
+void gca_alias_dealloc(GcaAlias *t)
+{
+  free(t->cols);
+  t->cols = NULL;
+  t->n = 0;
+}
+
+void gca_alias_draw_n(const GcaAlias *t, size_t *out, size_t m, GcaRand *r)
+{
+  size_t i;
+  for(i = 0; i < m; i++) out[i] = gca_alias_draw(t, r);
+}
+
+typedef struct { double key; size_t idx; } _GcaWeightedKey;
+
+// Heap top is the largest key, the first to be replaced
+static int _gca_weighted_cmp(const void *a, const void *b, void *arg)
+{
+  (void)arg;
+  double x = ((const _GcaWeightedKey*)a)->key;
+  double y = ((const _GcaWeightedKey*)b)->key;
+  return (x > y) - (x < y);
+}
+
+size_t gca_sample_weighted(size_t *idx, const double *w, size_t n, size_t m,
+                           GcaRand *r)
+{
+  size_t i, k = 0;
+  _GcaWeightedKey *heap, e;
+  if(m > n) m = n;
+  if(!m || !(heap = malloc(m * sizeof(_GcaWeightedKey)))) return 0;
+
+  // key is log(u)/w, in the same order as u^(1/w)
+  for(i = 0; i < n; i++) {
+    if(!(w[i] > 0)) continue;
+    e.key = -log(_gca_rand_open(r)) / w[i]; // smaller is better
+    e.idx = i;
+    if(k < m) {
+      heap[k++] = e;
+      gca_heap_pushup(heap, k, sizeof(e), _gca_weighted_cmp, NULL);
+    }
+    else if(e.key < heap[0].key) {
+      heap[0] = e;
+      gca_heap_pushdwn(heap, k, sizeof(e), _gca_weighted_cmp, NULL);
+    }
+  }
+
+  // sorted by key: the order of drawing one at a time
+  gca_heap_sort(heap, k, sizeof(e), _gca_weighted_cmp, NULL);
+  for(i = 0; i < k; i++) idx[i] = heap[i].idx;
+  free(heap);
+  return k;
+}
+
+//
+// Typed reductions
+//
+// Loops keep GCA_REDUCE_LANES independent accumulators so that the compiler
+// can vectorise them; a single accumulator is a serial dependency chain, and
+// for floats it would also fix the order of operations. argmin/argmax find
+// the min of each block, and only scan a block for its index if it beats the
+// best so far.
+//
+
+#define GCA_REDUCE_LANES 8
+#define GCA_REDUCE_BLOCK 256 // argmin / argmax block, multiple of LANES
+#define GCA_SUM_BLOCK 128 // pairwise summation leaf size, multiple of LANES
+
+#define reducefuncs(name,type_t,sum_t,acc_t)                                   \
+void gca_minmax_##name(const type_t *arr, size_t n, type_t *min, type_t *max)  \
+{                                                                              \
+  type_t lo[GCA_REDUCE_LANES], hi[GCA_REDUCE_LANES], x;                        \
+  size_t i, j;                                                                 \
+  if(!n) return;                                                               \
+  for(j = 0; j < GCA_REDUCE_LANES; j++) lo[j] = hi[j] = arr[0];                \
+  for(i = 0; i + GCA_REDUCE_LANES <= n; i += GCA_REDUCE_LANES) {               \
+    for(j = 0; j < GCA_REDUCE_LANES; j++) {                                    \
+      x = arr[i+j];                                                            \
+      lo[j] = x < lo[j] ? x : lo[j];                                           \
+      hi[j] = x > hi[j] ? x : hi[j];                                           \
+    }                                                                          \
+  }                                                                            \
+  for(j = 0; i+j < n; j++) {                                                   \
+    x = arr[i+j];                                                              \
+    lo[j] = x < lo[j] ? x : lo[j];                                             \
+    hi[j] = x > hi[j] ? x : hi[j];                                             \
+  }                                                                            \
+  for(j = 1; j < GCA_REDUCE_LANES; j++) {                                      \
+    if(lo[j] < lo[0]) lo[0] = lo[j];                                           \
+    if(hi[j] > hi[0]) hi[0] = hi[j];                                           \
+  }                                                                            \
+  *min = lo[0];                                                                \
+  *max = hi[0];                                                                \
+}                                                                              \
+                                                                               \
+size_t gca_argmin_##name(const type_t *arr, size_t n)                          \
+{                                                                              \
+  type_t best, lo, hi;                                                         \
+  size_t i, m, besti = 0;                                                      \
+  if(!n) return 0;                                                             \
+  for(best = arr[0], i = 0; i < n; i += m) {                                   \
+    m = n-i < GCA_REDUCE_BLOCK ? n-i : GCA_REDUCE_BLOCK;                       \
+    gca_minmax_##name(arr+i, m, &lo, &hi);                                     \
+    if(lo < best) {                                                            \
+      for(besti = i; arr[besti] != lo; besti++) {}                             \
+      best = lo;                                                               \
+    }                                                                          \
+  }                                                                            \
+  return besti;                                                                \
+}                                                                              \
+                                                                               \
+size_t gca_argmax_##name(const type_t *arr, size_t n)                          \
+{                                                                              \
+  type_t best, lo, hi;                                                         \
+  size_t i, m, besti = 0;                                                      \
+  if(!n) return 0;                                                             \
+  for(best = arr[0], i = 0; i < n; i += m) {                                   \
+    m = n-i < GCA_REDUCE_BLOCK ? n-i : GCA_REDUCE_BLOCK;                       \
+    gca_minmax_##name(arr+i, m, &lo, &hi);                                     \
+    if(hi > best) {                                                            \
+      for(besti = i; arr[besti] != hi; besti++) {}                             \
+      best = hi;                                                               \
+    }                                                                          \
+  }                                                                            \
+  return besti;                                                                \
+}                                                                              \
+                                                                               \
+static acc_t _gca_sum_##name(const type_t *arr, size_t n)                      \
+{                                                                              \
+  acc_t s[GCA_REDUCE_LANES] = {0};                                             \
+  size_t i, j, half;                                                           \
+  if(n > GCA_SUM_BLOCK) {                                                      \
+    /* split on a multiple of the leaf size */                                 \
+    half = (n / GCA_SUM_BLOCK / 2 + 1) * GCA_SUM_BLOCK;                        \
+    if(half >= n) half = n / 2;                                                \
+    return _gca_sum_##name(arr, half) + _gca_sum_##name(arr+half, n-half);     \
+  }                                                                            \
+  for(i = 0; i + GCA_REDUCE_LANES <= n; i += GCA_REDUCE_LANES)                 \
+    for(j = 0; j < GCA_REDUCE_LANES; j++) s[j] += (acc_t)arr[i+j];             \
+  for(j = 0; i+j < n; j++) s[j] += (acc_t)arr[i+j];                            \
+  /* add lanes pairwise too */                                                 \
+  for(j = GCA_REDUCE_LANES/2; j > 0; j /= 2)                                   \
+    for(i = 0; i < j; i++) s[i] += s[i+j];                                     \
+  return s[0];                                                                 \
+}                                                                              \
+                                                                               \
+sum_t gca_sum_##name(const type_t *arr, size_t n)                              \
+{                                                                              \
+  return (sum_t)_gca_sum_##name(arr, n);                                       \
+}
+
+// 64 bit integers are summed unsigned, so that overflow wraps
+reducefuncs(int32,  int32_t,  int64_t,  int64_t)
+reducefuncs(uint32, uint32_t, uint64_t, uint64_t)
+reducefuncs(int64,  int64_t,  int64_t,  uint64_t)
+reducefuncs(uint64, uint64_t, uint64_t, uint64_t)
+reducefuncs(float,  float,    double,   double)
+reducefuncs(double, double,   double,   double)
+#undef reducefuncs
+
 
 // Merge two sorted arrays to create a merged sorted array
 void gca_merge(void *_dst, size_t ndst, size_t nsrc, size_t es,
@@ -116,7 +666,7 @@ void gca_merge(void *_dst, size_t ndst, size_t nsrc, size_t es,
   if(!nsrc || !ndst) {}
   else if(compar(src-es, src, arg) <= 0) {}
   else if(compar(dst, end-es, arg) >= 0) {
-    gca_cycle_left(dst, ndst, es, ndst);
+    gca_cycle_left(dst, ndst+nsrc, es, ndst);
   }
   else if(ndst+nsrc < 6) {
     // insertion sort merge of dst and src
@@ -127,6 +677,431 @@ void gca_merge(void *_dst, size_t ndst, size_t nsrc, size_t es,
   }
 }
 
+//
+// Sorted set operations
+//
+
+enum { _GCA_SET_ISECT, _GCA_SET_COUNT, _GCA_SET_UNION, _GCA_SET_DIFF };
+
+// Copy n elements, which may overlap, unless they're already in place
+static inline void _gca_set_copy(char *dst, const char *src, size_t n,
+                                 size_t es)
+{
+  if(dst != src && n) memmove(dst, src, es*n);
+}
+
+// Write n elements from src to out[nout] unless we're only counting.
+// Returns the new output size
+static inline size_t _gca_set_emit(char *out, size_t nout, const char *src,
+                                   size_t n, size_t es, int op)
+{
+  if(op != _GCA_SET_COUNT) _gca_set_copy(out+es*nout, src, n, es);
+  return nout + n;
+}
+
+// Index of the first element of b[0..n) that is >= x. Doubles the step until
+// it passes x, then binary searches the last step. O(log i) for answer i
+static inline size_t _gca_gallop(const char *b, size_t n, size_t es,
+                                 const void *x,
+                                 int (*compar)(const void *_a, const void *_b,
+                                               void *_arg),
+                                 void *arg)
+{
+  size_t lo = 0, hi = 1, mid;
+  // b[0..lo) < x
+  while(hi <= n && compar(b+es*(hi-1), x, arg) < 0) { lo = hi; hi *= 2; }
+  // answer is in [lo, hi-1]
+  if(hi > n) hi = n+1;
+  for(hi--; lo < hi; ) {
+    mid = lo + (hi-lo)/2;
+    if(compar(b+es*mid, x, arg) < 0) lo = mid+1;
+    else hi = mid;
+  }
+  return lo;
+}
+
+static inline size_t _gca_set_op(const char *a, size_t na,
+                                 const char *b, size_t nb, size_t es,
+                                 int (*compar)(const void *_a, const void *_b,
+                                               void *_arg),
+                                 void *arg, char *out, int op)
+{
+  size_t i = 0, j = 0, k, n = 0;
+  bool eq, keepa = (op == _GCA_SET_UNION || op == _GCA_SET_DIFF);
+  int c;
+
+  if(nb / GCA_SET_GALLOP > na) {
+    // find each element of a in b
+    for(; i < na; i++) {
+      k = _gca_gallop(b+es*j, nb-j, es, a+es*i, compar, arg);
+      if(op == _GCA_SET_UNION) n = _gca_set_emit(out, n, b+es*j, k, es, op);
+      j += k;
+      eq = (j < nb && compar(a+es*i, b+es*j, arg) == 0);
+      j += eq;
+      if(eq ? op != _GCA_SET_DIFF : keepa)
+        n = _gca_set_emit(out, n, a+es*i, 1, es, op);
+    }
+  }
+  else if(na / GCA_SET_GALLOP > nb) {
+    // find each element of b in a
+    for(; j < nb; j++) {
+      k = _gca_gallop(a+es*i, na-i, es, b+es*j, compar, arg);
+      if(keepa) n = _gca_set_emit(out, n, a+es*i, k, es, op);
+      i += k;
+      if(i < na && compar(a+es*i, b+es*j, arg) == 0) {
+        if(op != _GCA_SET_DIFF) n = _gca_set_emit(out, n, a+es*i, 1, es, op);
+        i++;
+      }
+      else if(op == _GCA_SET_UNION)
+        n = _gca_set_emit(out, n, b+es*j, 1, es, op);
+    }
+  }
+  else {
+    while(i < na && j < nb) {
+      c = compar(a+es*i, b+es*j, arg);
+      if(c < 0) {
+        if(keepa) n = _gca_set_emit(out, n, a+es*i, 1, es, op);
+        i++;
+      }
+      else if(c > 0) {
+        if(op == _GCA_SET_UNION) n = _gca_set_emit(out, n, b+es*j, 1, es, op);
+        j++;
+      }
+      else {
+        if(op != _GCA_SET_DIFF) n = _gca_set_emit(out, n, a+es*i, 1, es, op);
+        i++; j++;
+      }
+    }
+  }
+
+  // whatever is left of a or b
+  if(keepa) n = _gca_set_emit(out, n, a+es*i, na-i, es, op);
+  if(op == _GCA_SET_UNION) n = _gca_set_emit(out, n, b+es*j, nb-j, es, op);
+  return n;
+}
+
+size_t gca_unique(void *base, size_t nel, size_t es,
+                  int (*compar)(const void *_a, const void *_b, void *_arg),
+                  void *arg)
+{
+  char *b = (char*)base;
+  size_t i, n = 1;
+  if(nel < 2) return nel;
+  for(i = 1; i < nel; i++) {
+    if(compar(b+es*(n-1), b+es*i, arg) != 0) {
+      if(n != i) memcpy(b+es*n, b+es*i, es);
+      n++;
+    }
+  }
+  return n;
+}
+
+size_t gca_set_intersect(const void *a, size_t na, const void *b, size_t nb,
+                         size_t es,
+                         int (*compar)(const void *_a, const void *_b,
+                                       void *_arg),
+                         void *arg, void *out)
+{
+  return _gca_set_op((const char*)a, na, (const char*)b, nb, es, compar, arg,
+                     (char*)out, _GCA_SET_ISECT);
+}
+
+size_t gca_set_union(const void *a, size_t na, const void *b, size_t nb,
+                     size_t es,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg, void *out)
+{
+  return _gca_set_op((const char*)a, na, (const char*)b, nb, es, compar, arg,
+                     (char*)out, _GCA_SET_UNION);
+}
+
+size_t gca_set_diff(const void *a, size_t na, const void *b, size_t nb,
+                    size_t es,
+                    int (*compar)(const void *_a, const void *_b, void *_arg),
+                    void *arg, void *out)
+{
+  return _gca_set_op((const char*)a, na, (const char*)b, nb, es, compar, arg,
+                     (char*)out, _GCA_SET_DIFF);
+}
+
+size_t gca_set_count_intersect(const void *a, size_t na,
+                               const void *b, size_t nb, size_t es,
+                               int (*compar)(const void *_a, const void *_b,
+                                             void *_arg),
+                               void *arg)
+{
+  return _gca_set_op((const char*)a, na, (const char*)b, nb, es, compar, arg,
+                     NULL, _GCA_SET_COUNT);
+}
+
+//
+// Typed set intersection
+//
+// Load four elements from each input and compare each element of one block
+// with all four of the other, by comparing against the other block rotated
+// 0-3 places. Then move on from whichever block has the smaller last
+// element, or both if they are equal. Matches are written out without
+// branching on them. Uses GCC / clang vector extensions, which compile to
+// SSE2 / AVX2 / NEON compares and shuffles.
+// Other compilers get the scalar merge.
+//
+
+#if defined(__clang__)
+  #define _gca_vrot(x,t,...) __builtin_shufflevector(x, x, __VA_ARGS__)
+#elif defined(__GNUC__)
+  #define _gca_vrot(x,t,...) __builtin_shuffle(x, (t){__VA_ARGS__})
+#endif
+
+#ifdef _gca_vrot
+  typedef uint32_t _gca_set_v32 __attribute__((vector_size(16)));
+  typedef uint64_t _gca_set_v64 __attribute__((vector_size(32)));
+  // Matching lanes are -1. Every lane is stored to out[n] and n only moves
+  // on past matches, so stop while out still has room for four stores. Those
+  // stores may overwrite a[i..i+3] when out is a, so a block is only loaded
+  // from memory when we move on to it, and if we stop before moving on from
+  // a's block its lanes are merged from a copy of va, not read back from a.
+  #define _gca_set_block(type_t,vec_t)                                         \
+    vec_t va, vb, nexta, nextb;                                                \
+    type_t rest[4];                                                            \
+    size_t cap = (na < nb ? na : nb);                                          \
+    bool adva, advb;                                                           \
+    if(i+4 <= na && j+4 <= nb && n+4 <= cap) {                                 \
+      memcpy(&va, a+i, sizeof(va));                                            \
+      memcpy(&vb, b+j, sizeof(vb));                                            \
+      while(1) {                                                               \
+        __typeof__(va == vb) m = (va == vb) |                                  \
+                                 (va == _gca_vrot(vb, vec_t, 1, 2, 3, 0)) |    \
+                                 (va == _gca_vrot(vb, vec_t, 2, 3, 0, 1)) |    \
+                                 (va == _gca_vrot(vb, vec_t, 3, 0, 1, 2));     \
+        if(out) {                                                              \
+          for(k = 0; k < 4; k++) { out[n] = va[k]; n += m[k] & 1; }            \
+        }                                                                      \
+        else n -= m[0] + m[1] + m[2] + m[3];                                   \
+        adva = (va[3] <= vb[3]);                                               \
+        advb = (vb[3] <= va[3]);                                               \
+        i += 4*adva;                                                           \
+        j += 4*advb;                                                           \
+        if(i+4 > na || j+4 > nb || n+4 > cap) break;                           \
+        memcpy(&nexta, a+i, sizeof(va));                                       \
+        memcpy(&nextb, b+j, sizeof(vb));                                       \
+        va = adva ? nexta : va;                                                \
+        vb = advb ? nextb : vb;                                                \
+      }                                                                        \
+      if(va[3] > vb[3]) { /* a's block is still current */                   \
+        memcpy(rest, &va, sizeof(va));                                         \
+        for(k = 0; k < 4 && j < nb; ) {                                        \
+          if(rest[k] < b[j]) k++;                                              \
+          else if(rest[k] > b[j]) j++;                                         \
+          else { if(out) out[n] = rest[k]; n++; k++; j++; }                    \
+        }                                                                      \
+        i += k;                                                                \
+      }                                                                        \
+    }
+#else
+  #define _gca_set_block(type_t,vec_t)
+#endif
+
+#define setfuncs(name,type_t,vec_t)                                            \
+/* Index of the first element of b[0..n) that is >= x */                      \
+static inline size_t _gca_gallop_##name(const type_t *b, size_t n, type_t x)   \
+{                                                                              \
+  size_t lo = 0, hi = 1, mid;                                                  \
+  while(hi <= n && b[hi-1] < x) { lo = hi; hi *= 2; }                          \
+  if(hi > n) hi = n+1;                                                         \
+  for(hi--; lo < hi; ) {                                                       \
+    mid = lo + (hi-lo)/2;                                                      \
+    if(b[mid] < x) lo = mid+1;                                                 \
+    else hi = mid;                                                             \
+  }                                                                            \
+  return lo;                                                                   \
+}                                                                              \
+                                                                               \
+/* out may be NULL to only count */                                            \
+static size_t _gca_set_intersect_##name(const type_t *a, size_t na,            \
+                                        const type_t *b, size_t nb,            \
+                                        type_t *out)                           \
+{                                                                              \
+  size_t i = 0, j = 0, k, n = 0;                                               \
+  if(na / GCA_SET_GALLOP > nb || nb / GCA_SET_GALLOP > na) {                   \
+    if(na <= nb) {                                                             \
+      for(; i < na && j < nb; i++) {                                           \
+        j += _gca_gallop_##name(b+j, nb-j, a[i]);                              \
+        if(j < nb && b[j] == a[i]) { if(out) out[n] = a[i]; n++; j++; }        \
+      }                                                                        \
+    } else {                                                                   \
+      for(; j < nb && i < na; j++) {                                           \
+        i += _gca_gallop_##name(a+i, na-i, b[j]);                              \
+        if(i < na && a[i] == b[j]) { if(out) out[n] = a[i]; n++; i++; }        \
+      }                                                                        \
+    }                                                                          \
+    return n;                                                                  \
+  }                                                                            \
+  _gca_set_block(type_t,vec_t)                                                 \
+  while(i < na && j < nb) {                                                    \
+    if(a[i] < b[j]) i++;                                                       \
+    else if(a[i] > b[j]) j++;                                                  \
+    else { if(out) out[n] = a[i]; n++; i++; j++; }                             \
+  }                                                                            \
+  return n;                                                                    \
+}                                                                              \
+                                                                               \
+size_t gca_set_intersect_##name(const type_t *a, size_t na,                    \
+                                const type_t *b, size_t nb, type_t *out)       \
+{                                                                              \
+  return _gca_set_intersect_##name(a, na, b, nb, out);                         \
+}                                                                              \
+                                                                               \
+size_t gca_set_count_intersect_##name(const type_t *a, size_t na,              \
+                                      const type_t *b, size_t nb)              \
+{                                                                              \
+  return _gca_set_intersect_##name(a, na, b, nb, NULL);                        \
+}
+
+setfuncs(uint32, uint32_t, _gca_set_v32)
+setfuncs(uint64, uint64_t, _gca_set_v64)
+#undef setfuncs
+#undef _gca_set_block
+
+//
+// K-way merge
+//
+
+#define _gca_mergek_done(m) ((m)->k == 0 || !(m)->tree[0].head)
+
+// Does a's head come before b's? Finished runs (head NULL) lose, ties go to
+// the lower run so the merge is stable
+static inline bool _gca_mergek_beats(const GcaMergeK *m, GcaMergeNode a,
+                                     GcaMergeNode b)
+{
+  int c;
+  if(!a.head || !b.head) return a.head != NULL;
+  c = m->compar(a.head, b.head, m->arg);
+  return (c < 0) | ((c == 0) & (a.run < b.run));
+}
+
+// Get the next block of run r
+static void _gca_mergek_fill(GcaMergeK *m, size_t r)
+{
+  const void *blk = NULL;
+  size_t n = m->fill ? m->fill(r, &blk, m->fillarg) : 0;
+  m->runs[r].ptr = n ? (const char*)blk : NULL;
+  m->runs[r].end = n ? (const char*)blk + m->es*n : NULL;
+}
+
+// Play the matches below node x. Leaves are nodes k..2k-1. Returns the winner
+static GcaMergeNode _gca_mergek_build(GcaMergeK *m, size_t x)
+{
+  if(x >= m->k) {
+    size_t r = x - m->k;
+    return (GcaMergeNode){.run = r, .head = m->runs[r].ptr};
+  }
+  GcaMergeNode l = _gca_mergek_build(m, 2*x), r = _gca_mergek_build(m, 2*x+1);
+  if(_gca_mergek_beats(m, l, r)) { m->tree[x] = r; return l; }
+  m->tree[x] = l;
+  return r;
+}
+
+// Take the winning element and replay its run's path to the root
+static inline void _gca_mergek_pop(GcaMergeK *m)
+{
+  GcaMergeNode tmp, w = m->tree[0];
+  GcaMergeRun *run = &m->runs[w.run];
+  size_t x;
+  uintptr_t mask, d;
+  run->ptr += m->es;
+  if(run->ptr == run->end) _gca_mergek_fill(m, w.run);
+  w.head = run->ptr;
+  for(x = (w.run + m->k) / 2; x > 0; x /= 2) {
+    tmp = m->tree[x];
+    mask = -(uintptr_t)_gca_mergek_beats(m, tmp, w);
+    // if w lost, swap it with the loser stored here
+    d = (tmp.run ^ w.run) & mask;
+    tmp.run ^= d; w.run ^= d;
+    d = ((uintptr_t)tmp.head ^ (uintptr_t)w.head) & mask;
+    tmp.head = (const char*)((uintptr_t)tmp.head ^ d);
+    w.head = (const char*)((uintptr_t)w.head ^ d);
+    m->tree[x] = tmp;
+  }
+  m->tree[0] = w;
+}
+
+static bool _gca_mergek_init(GcaMergeK *m, size_t k, size_t es,
+                             int (*compar)(const void *_a, const void *_b,
+                                           void *_arg),
+                             void *arg,
+                             size_t (*fill)(size_t _run, const void **_block,
+                                            void *_fillarg),
+                             void *fillarg)
+{
+  GcaMergeK tmp = {.k = k, .es = es, .pending = false,
+                   .tree = malloc((k ? k : 1) * sizeof(GcaMergeNode)),
+                   .runs = malloc((k ? k : 1) * sizeof(GcaMergeRun)),
+                   .compar = compar, .arg = arg,
+                   .fill = fill, .fillarg = fillarg};
+  memcpy(m, &tmp, sizeof(GcaMergeK));
+  if(!m->tree || !m->runs) { gca_mergek_dealloc(m); return false; }
+  return true;
+}
+
+bool gca_mergek_alloc(GcaMergeK *m, size_t k, size_t es,
+                      int (*compar)(const void *_a, const void *_b, void *_arg),
+                      void *arg,
+                      size_t (*fill)(size_t _run, const void **_block,
+                                     void *_fillarg),
+                      void *fillarg)
+{
+  size_t r;
+  if(!_gca_mergek_init(m, k, es, compar, arg, fill, fillarg)) return false;
+  for(r = 0; r < k; r++) _gca_mergek_fill(m, r);
+  if(k) m->tree[0] = _gca_mergek_build(m, 1);
+  return true;
+}
+
+void gca_mergek_dealloc(GcaMergeK *m)
+{
+  free(m->tree);
+  free(m->runs);
+  m->tree = NULL;
+  m->runs = NULL;
+}
+
+const void* gca_mergek_next(GcaMergeK *m)
+{
+  if(m->pending) _gca_mergek_pop(m);
+  m->pending = !_gca_mergek_done(m);
+  return m->pending ? m->tree[0].head : NULL;
+}
+
+size_t gca_mergek_read(GcaMergeK *m, void *out, size_t n)
+{
+  char *dst = (char*)out;
+  size_t i, es = m->es;
+  if(m->pending) { _gca_mergek_pop(m); m->pending = false; }
+  for(i = 0; i < n && !_gca_mergek_done(m); i++) {
+    memcpy(dst + es*i, m->tree[0].head, es);
+    _gca_mergek_pop(m);
+  }
+  return i;
+}
+
+bool gca_merge_k(const void *const runs[], const size_t lens[], size_t k,
+                 size_t es, void *out,
+                 int (*compar)(const void *_a, const void *_b, void *_arg),
+                 void *arg)
+{
+  GcaMergeK m;
+  size_t r;
+  if(!_gca_mergek_init(&m, k, es, compar, arg, NULL, NULL)) return false;
+  for(r = 0; r < k; r++) {
+    m.runs[r].ptr = lens[r] ? (const char*)runs[r] : NULL;
+    m.runs[r].end = lens[r] ? (const char*)runs[r] + es*lens[r] : NULL;
+  }
+  if(k) m.tree[0] = _gca_mergek_build(&m, 1);
+  gca_mergek_read(&m, out, SIZE_MAX);
+  gca_mergek_dealloc(&m);
+  return true;
+}
+
 // binary search
 // searchf is a function that compares a given value with the value we are
 // searching for. It returns <0 if _val is < target, >0 if _val is > target,
@@ -267,6 +1242,236 @@ void* gca_qselect(void *base, size_t nel, size_t es, size_t kidx,
   return b+es*kidx;
 }
 
+//
+// Selection without reordering the input
+//
+
+// Range of values [lo,hi], either end may be exclusive or unbounded.
+// lo and hi point to storage owned by the band.
+typedef struct {
+  char *lo, *hi;
+  bool haslo, hashi, loex, hiex;
+} _GcaBand;
+
+static inline void _gca_band_set_lo(_GcaBand *bd, const void *x, bool ex,
+                                    size_t es)
+{
+  memcpy(bd->lo, x, es);
+  bd->haslo = true;
+  bd->loex = ex;
+}
+
+static inline void _gca_band_set_hi(_GcaBand *bd, const void *x, bool ex,
+                                    size_t es)
+{
+  memcpy(bd->hi, x, es);
+  bd->hashi = true;
+  bd->hiex = ex;
+}
+
+static inline void _gca_band_copy(_GcaBand *dst, const _GcaBand *src, size_t es)
+{
+  if(src->haslo) _gca_band_set_lo(dst, src->lo, src->loex, es);
+  if(src->hashi) _gca_band_set_hi(dst, src->hi, src->hiex, es);
+  dst->haslo = src->haslo;
+  dst->hashi = src->hashi;
+}
+
+// Read the whole array once. Count elements below the band, copy the first
+// cap elements inside it to buf and feed them all to the reservoir.
+// Returns the number of elements inside the band.
+static size_t _gca_select_pass(const char *b, size_t nel, size_t es,
+                               const _GcaBand *bd,
+                               int (*compar)(const void *_a, const void *_b,
+                                             void *_arg),
+                               void *arg, size_t *nbelow,
+                               char *buf, size_t cap, GcaReservoir *rs)
+{
+  size_t i, nb = 0, nin = 0, run = 0;
+  int cl, ch, below, above, loex = bd->loex, hiex = bd->hiex;
+  for(i = 0; i < nel; i++) {
+    // make both comparisons without branching on the first: about half the
+    // elements are below the band, so that branch would often mispredict
+    cl = bd->haslo ? compar(b+es*i, bd->lo, arg) : 1;
+    ch = bd->hashi ? compar(b+es*i, bd->hi, arg) : -1;
+    below = cl < loex;
+    above = ch > -hiex;
+    nb += below;
+    if(!(below | above)) {
+      if(nin < cap) memcpy(buf+es*nin, b+es*i, es);
+      nin++;
+      run++;
+    }
+    else if(run) {
+      // feed runs of elements inside the band in one call
+      gca_reservoir_add_n(rs, b+es*(i-run), run);
+      run = 0;
+    }
+  }
+  if(run) gca_reservoir_add_n(rs, b+es*(nel-run), run);
+  *nbelow = nb;
+  return nin;
+}
+
+// Copy the smallest element greater than x to out
+static void _gca_select_succ(const char *b, size_t nel, size_t es,
+                             const void *x,
+                             int (*compar)(const void *_a, const void *_b,
+                                           void *_arg),
+                             void *arg, char *out)
+{
+  const char *ptr, *end = b+es*nel, *best = NULL;
+  for(ptr = b; ptr < end; ptr += es)
+    if(compar(ptr, x, arg) > 0 && (!best || compar(ptr, best, arg) < 0))
+      best = ptr;
+  assert(best);
+  memcpy(out, best, es);
+}
+
+// Find the k-th smallest element, and the (k+1)-th if next is not NULL
+static void _gca_select_ro(const void *base, size_t nel, size_t es, size_t k,
+                           int (*compar)(const void *_a, const void *_b,
+                                         void *_arg),
+                           void *arg, char *out, char *next)
+{
+  const char *b = (const char*)base;
+  size_t i, kk, nbelow = 0, nband = nel, lastband = nel, ns, pos, d;
+  size_t cap = 4*(size_t)sqrt((double)nel), s;
+  char store[5*es], *buf, *smp;
+  _GcaBand cur = {.lo = store, .hi = store+es},
+           prev = {.lo = store+2*es, .hi = store+3*es};
+  GcaReservoir rs;
+  GcaRand r;
+
+  assert(k < nel && (!next || k+1 < nel));
+
+  if(cap < GCA_SELECT_RO_MIN) cap = GCA_SELECT_RO_MIN;
+  if(cap > nel) cap = nel;
+  if(!(buf = malloc(2 * es * cap))) {
+    // no memory: sample one pivot at a time
+    cap = 0;
+    s = 1;
+    smp = store+4*es;
+  }
+  else {
+    s = cap;
+    smp = buf+es*cap;
+  }
+  gca_rand_seed(&r, 0x5e1ec7ULL ^ nel ^ ((uint64_t)k << 32));
+
+  if(nel <= cap) memcpy(buf, b, es*nel);
+  else {
+    // first sample reads only the elements picked
+    ns = gca_sample_copy(b, nel, es, s, smp, &r);
+    lastband = SIZE_MAX;
+
+    while(1)
+    {
+      // pick bounds either side of rank k from the sorted sample
+      gca_qsort(smp, ns, es, compar, arg);
+      pos = (size_t)((double)(k - nbelow) * ns / nband);
+      if(pos >= ns) pos = ns-1;
+      if(nband >= lastband) {
+        // last bounds made no progress, try a single value
+        _gca_band_set_lo(&cur, smp+es*pos, false, es);
+        _gca_band_set_hi(&cur, smp+es*pos, false, es);
+      } else {
+        d = 3*(size_t)sqrt((double)ns)/2 + 1;
+        if(pos >= d) _gca_band_set_lo(&cur, smp+es*(pos-d), false, es);
+        if(pos+d+(next != NULL) < ns)
+          _gca_band_set_hi(&cur, smp+es*(pos+d+(next != NULL)), false, es);
+      }
+      lastband = nband;
+
+      while(1) {
+        gca_reservoir_init(&rs, smp, es, s, &r);
+
+        nband = _gca_select_pass(b, nel, es, &cur, compar, arg, &nbelow,
+                                 buf, cap, &rs);
+        if(nbelow > k) {
+          // missed low: rank k is between the last good lo and this lo
+          _gca_band_set_hi(&cur, cur.lo, true, es);
+          cur.haslo = prev.haslo;
+          if(prev.haslo) _gca_band_set_lo(&cur, prev.lo, prev.loex, es);
+        }
+        else if(nbelow + nband <= k) {
+          // missed high
+          _gca_band_set_lo(&cur, cur.hi, true, es);
+          cur.hashi = prev.hashi;
+          if(prev.hashi) _gca_band_set_hi(&cur, prev.hi, prev.hiex, es);
+        }
+        else break;
+      }
+
+      _gca_band_copy(&prev, &cur, es);
+      ns = gca_reservoir_size(&rs);
+
+      if(cur.haslo && cur.hashi && !cur.loex && !cur.hiex &&
+         compar(cur.lo, cur.hi, arg) == 0)
+      {
+        // every element in the band has the same value
+        memcpy(out, cur.lo, es);
+        if(next) {
+          if(k+1 < nbelow + nband) memcpy(next, out, es);
+          else _gca_select_succ(b, nel, es, out, compar, arg, next);
+        }
+        free(buf);
+        return;
+      }
+
+      if(nband <= cap) break;
+    }
+  }
+
+  // rank k is in buf
+  kk = k - nbelow;
+  memcpy(out, gca_qselect(buf, nband, es, kk, compar, arg), es);
+  if(next) {
+    i = kk+1;
+    if(i < nband) memcpy(next, gca_min(buf+es*i, nband-i, es, compar, arg), es);
+    else _gca_select_succ(b, nel, es, out, compar, arg, next);
+  }
+  free(buf);
+}
+
+void* gca_select_ro(const void *base, size_t nel, size_t es, size_t kidx,
+                    int (*compar)(const void *_a, const void *_b, void *_arg),
+                    void *arg, void *out)
+{
+  _gca_select_ro(base, nel, es, kidx, compar, arg, (char*)out, NULL);
+  return out;
+}
+
+void* gca_select2_ro(const void *base, size_t nel, size_t es, size_t kidx,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg, void *out)
+{
+  _gca_select_ro(base, nel, es, kidx, compar, arg,
+                 (char*)out, (char*)out+es);
+  return out;
+}
+
+#define medianrofunc(name,type_t,avgfunc)                                      \
+type_t gca_median_ro_##name(const type_t *arr, size_t n)                       \
+{                                                                              \
+  type_t m[2];                                                                 \
+  if(n == 0) return 0;                                                         \
+  if(n & 1) {                                                                  \
+    gca_select_ro(arr, n, sizeof(type_t), n/2, gca_cmp2_##name, NULL, m);      \
+    return m[0];                                                               \
+  }                                                                            \
+  gca_select2_ro(arr, n, sizeof(type_t), n/2-1, gca_cmp2_##name, NULL, m);     \
+  return (type_t)avgfunc(m[0], m[1]);                                          \
+}
+medianrofunc(uint32, uint32_t, gca_ab_mean_int)
+medianrofunc(uint64, uint64_t, gca_ab_mean_int)
+medianrofunc(int,    int,      gca_ab_mean_int)
+medianrofunc(long,   long,     gca_ab_mean_int)
+medianrofunc(size,   size_t,   gca_ab_mean_int)
+medianrofunc(float,  float,    gca_ab_mean_real)
+medianrofunc(double, double,   gca_ab_mean_real)
+#undef medianrofunc
+
 // Get k-th element from unsorted array, using quickselect and median of medians
 // void gca_qselect_mmed(void *base, size_t nel, size_t es, size_t kidx,
 //                       int (*compar)(const void *_a, const void *_b, void *_arg),
@@ -300,10 +1505,11 @@ void gca_heap_pushdwn(void *heap, size_t nel, size_t es,
                       int (*compar)(const void *_a, const void *_b, void *_arg),
                       void *arg)
 {
-  char tmp[es], *b = (char*)heap, *last = b+es*(nel-1), *p, *ch;
-  memcpy(tmp, last, es);
-  for(p = b, ch = b+es; ch < last; p = ch, ch = b + 2*(ch-b) + es) {
-    ch = (ch+es < last && compar(ch,ch+es,arg) < 0 ? ch+es : ch); // biggest child
+  if(nel <= 1) return;
+  char tmp[es], *b = (char*)heap, *end = b+es*nel, *p, *ch;
+  memcpy(tmp, b, es);
+  for(p = b, ch = b+es; ch < end; p = ch, ch = b + 2*(ch-b) + es) {
+    ch = (ch+es < end && compar(ch,ch+es,arg) < 0 ? ch+es : ch); // biggest child
     if(compar(tmp, ch, arg) >= 0) break;
     memcpy(p, ch, es);
   }
@@ -337,6 +1543,230 @@ void gca_heap_sort(void *heap, size_t nel, size_t es,
   gca_swapm(b, b+es, es);
 }
 
+// Move the top of the heap to index nel-1, leaving a heap of nel-1 elements
+void gca_heap_pop(void *heap, size_t nel, size_t es,
+                  int (*compar)(const void *_a, const void *_b, void *_arg),
+                  void *arg)
+{
+  if(nel <= 1) return;
+  char *b = (char*)heap;
+  gca_swapm(b, b+es*(nel-1), es);
+  gca_heap_pushdwn(heap, nel-1, es, compar, arg);
+}
+
+//
+// d-ary heaps
+//
+
+// d is a compile-time constant in each of the wrappers below, so the
+// divisions and multiplications reduce to shifts
+
+// Element at index chi, to be pushed up the heap
+static inline void _heapd_siftup(char *b, size_t chi, size_t es, size_t d,
+                                 int (*compar)(const void *_a, const void *_b,
+                                               void *_arg),
+                                 void *arg)
+{
+  size_t pi;
+  char tmp[es];
+  memcpy(tmp, b+es*chi, es);
+  for(; chi > 0; chi = pi) {
+    pi = (chi-1)/d;
+    if(compar(b+es*pi, tmp, arg) >= 0) break;
+    memcpy(b+es*chi, b+es*pi, es);
+  }
+  memcpy(b+es*chi, tmp, es);
+}
+
+// Element at index pi, to be pushed down a heap of nel elements
+static inline void _heapd_siftdwn(char *b, size_t pi, size_t nel, size_t es,
+                                  size_t d,
+                                  int (*compar)(const void *_a, const void *_b,
+                                                void *_arg),
+                                  void *arg)
+{
+  size_t ci, cend, maxi;
+  char tmp[es];
+  memcpy(tmp, b+es*pi, es);
+  while((ci = d*pi+1) < nel) {
+    // find biggest child
+    cend = ci+d < nel ? ci+d : nel;
+    for(maxi = ci++; ci < cend; ci++)
+      if(compar(b+es*maxi, b+es*ci, arg) < 0) maxi = ci;
+    if(compar(tmp, b+es*maxi, arg) >= 0) break;
+    memcpy(b+es*pi, b+es*maxi, es);
+    pi = maxi;
+  }
+  memcpy(b+es*pi, tmp, es);
+}
+
+#define heapdfuncs(d)                                                          \
+void gca_heap##d##_pushup(void *heap, size_t nel, size_t es,                   \
+                          int (*compar)(const void *_a, const void *_b,        \
+                                        void *_arg),                           \
+                          void *arg)                                           \
+{                                                                              \
+  if(nel > 1) _heapd_siftup((char*)heap, nel-1, es, d, compar, arg);           \
+}                                                                              \
+void gca_heap##d##_pushdwn(void *heap, size_t nel, size_t es,                  \
+                           int (*compar)(const void *_a, const void *_b,       \
+                                         void *_arg),                          \
+                           void *arg)                                          \
+{                                                                              \
+  if(nel > 1) _heapd_siftdwn((char*)heap, 0, nel, es, d, compar, arg);         \
+}                                                                              \
+/* Bottom-up heap construction, O(nel) */                                      \
+void gca_heap##d##_make(void *base, size_t nel, size_t es,                     \
+                        int (*compar)(const void *_a, const void *_b,          \
+                                      void *_arg),                             \
+                        void *arg)                                             \
+{                                                                              \
+  size_t i;                                                                    \
+  if(nel <= 1) return;                                                         \
+  for(i = (nel-2)/d+1; i-- > 0; )                                              \
+    _heapd_siftdwn((char*)base, i, nel, es, d, compar, arg);                   \
+}                                                                              \
+void gca_heap##d##_sort(void *heap, size_t nel, size_t es,                     \
+                        int (*compar)(const void *_a, const void *_b,          \
+                                      void *_arg),                             \
+                        void *arg)                                             \
+{                                                                              \
+  char *b = (char*)heap;                                                       \
+  for(; nel > 1; nel--) {                                                      \
+    gca_swapm(b, b+es*(nel-1), es);                                            \
+    _heapd_siftdwn(b, 0, nel-1, es, d, compar, arg);                           \
+  }                                                                            \
+}                                                                              \
+void gca_heap##d##_pop(void *heap, size_t nel, size_t es,                      \
+                       int (*compar)(const void *_a, const void *_b,           \
+                                     void *_arg),                              \
+                       void *arg)                                              \
+{                                                                              \
+  char *b = (char*)heap;                                                       \
+  if(nel <= 1) return;                                                         \
+  gca_swapm(b, b+es*(nel-1), es);                                              \
+  _heapd_siftdwn(b, 0, nel-1, es, d, compar, arg);                             \
+}
+
+heapdfuncs(4)
+heapdfuncs(8)
+#undef heapdfuncs
+
+//
+// Min-max heaps
+//
+
+// dir is 1 on min levels and -1 on max levels, so that
+// _mm_before(i,j) is true if element i belongs above element j
+#define _mm_before(i,j) (dir*compar(b+es*(i), b+es*(j), arg) < 0)
+
+static inline int _mm_level_dir(size_t idx)
+{
+  size_t lvl;
+  for(lvl = 0, idx++; idx > 1; idx >>= 1) lvl++;
+  return lvl & 1 ? -1 : 1;
+}
+
+// Element at idx, to be pushed down a heap of nel elements
+static void _mm_trickledwn(char *b, size_t idx, size_t nel, size_t es,
+                           int (*compar)(const void *_a, const void *_b,
+                                         void *_arg),
+                           void *arg)
+{
+  int dir = _mm_level_dir(idx);
+  size_t c, m, i, end;
+
+  while((c = gca_heap_child1(idx)) < nel)
+  {
+    // m is the smallest (largest on max levels) child or grandchild
+    m = c;
+    if(c+1 < nel && _mm_before(c+1, m)) m = c+1;
+    for(i = gca_heap_child1(c), end = i+4 < nel ? i+4 : nel; i < end; i++)
+      if(_mm_before(i, m)) m = i;
+
+    if(!_mm_before(m, idx)) break;
+    gca_swapm(b+es*m, b+es*idx, es);
+    if(m < gca_heap_child1(c)) break; // m was a child, it's a leaf of idx now
+    // m was a grandchild, fix up against its parent on the opposite level
+    if(_mm_before(gca_heap_parent(m), m))
+      gca_swapm(b+es*m, b+es*gca_heap_parent(m), es);
+    idx = m;
+  }
+}
+
+// New element at index nel-1, to be pushed up the heap
+void gca_mmheap_pushup(void *heap, size_t nel, size_t es,
+                       int (*compar)(const void *_a, const void *_b, void *_arg),
+                       void *arg)
+{
+  if(nel <= 1) return;
+  char *b = (char*)heap;
+  size_t idx = nel-1, p = gca_heap_parent(idx), gp;
+  int dir = _mm_level_dir(idx);
+
+  // if out of order with parent, move onto the parent's levels
+  if(_mm_before(p, idx)) { gca_swapm(b+es*p, b+es*idx, es); idx = p; dir = -dir; }
+
+  // move up through grandparents on the same kind of level
+  for(; idx > 2; idx = gp) {
+    gp = gca_heap_parent(gca_heap_parent(idx));
+    if(!_mm_before(idx, gp)) break;
+    gca_swapm(b+es*gp, b+es*idx, es);
+  }
+}
+
+// Build a min-max heap in O(nel)
+void gca_mmheap_make(void *base, size_t nel, size_t es,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg)
+{
+  size_t i;
+  if(nel <= 1) return;
+  for(i = nel/2; i-- > 0; )
+    _mm_trickledwn((char*)base, i, nel, es, compar, arg);
+}
+
+static inline size_t _mm_max_idx(char *b, size_t nel, size_t es,
+                                 int (*compar)(const void *_a, const void *_b,
+                                               void *_arg),
+                                 void *arg)
+{
+  if(nel <= 2) return nel-1;
+  return compar(b+es, b+es*2, arg) >= 0 ? 1 : 2;
+}
+
+void* gca_mmheap_max(void *heap, size_t nel, size_t es,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg)
+{
+  return (char*)heap + es*_mm_max_idx((char*)heap, nel, es, compar, arg);
+}
+
+// Move the min element to index nel-1, leaving a heap of nel-1 elements
+void gca_mmheap_popmin(void *heap, size_t nel, size_t es,
+                       int (*compar)(const void *_a, const void *_b, void *_arg),
+                       void *arg)
+{
+  if(nel <= 1) return;
+  char *b = (char*)heap;
+  gca_swapm(b, b+es*(nel-1), es);
+  _mm_trickledwn(b, 0, nel-1, es, compar, arg);
+}
+
+// Move the max element to index nel-1, leaving a heap of nel-1 elements
+void gca_mmheap_popmax(void *heap, size_t nel, size_t es,
+                       int (*compar)(const void *_a, const void *_b, void *_arg),
+                       void *arg)
+{
+  if(nel <= 1) return;
+  char *b = (char*)heap;
+  size_t m = _mm_max_idx(b, nel, es, compar, arg);
+  gca_swapm(b+es*m, b+es*(nel-1), es);
+  if(m < nel-1) _mm_trickledwn(b, m, nel-1, es, compar, arg);
+}
+
+#undef _mm_before
+
 //
 // Median
 //
@@ -394,9 +1824,28 @@ size_t* gca_itr_reset(size_t *p, size_t n)
   return p;
 }
 
+// Step p to the next permutation in lexicographic order
+// Returns false if p was the last
+static bool _gca_perm_next(size_t *p, size_t n)
+{
+  size_t i, j;
+
+  // find i such that p[i-1] < p[i]
+  i = n-1;
+  while(i > 0 && p[i-1] >= p[i]) i--;
+  if(!i) return false; // end; hit max e.g 4,3,2,1
+  // find last j following i-1 where that p[i-1] < p[j]
+  for(j = i; j+1 < n && p[i-1] < p[j+1]; j++) {}
+
+  // printf(" i:%zu j:%zu\n", i-1, j);
+  SWAP(p[i-1], p[j]);
+  gca_reverse(p+i, n-i, sizeof(p[0]));
+  return true;
+}
+
 size_t* gca_itr_next(size_t **pp, size_t n, size_t *init)
 {
-  size_t i, j, *p = *pp;
+  size_t i, *p = *pp;
 
   if(!n) return NULL;
   if(!*pp) {
@@ -409,16 +1858,275 @@ size_t* gca_itr_next(size_t **pp, size_t n, size_t *init)
     return p;
   }
 
-  // find i such that p[i-1] < p[i]
-  i = n-1;
-  while(i > 0 && p[i-1] >= p[i]) i--;
-  if(!i) return NULL; // end; hit max e.g 4,3,2,1
-  // find last j following i-1 where that p[i-1] < p[j]
-  for(j = i; j+1 < n && p[i-1] < p[j+1]; j++) {}
+  return _gca_perm_next(p, n) ? p : NULL;
+}
 
-  // printf(" i:%zu j:%zu\n", i-1, j);
-  SWAP(p[i-1], p[j]);
-  gca_reverse(p+i, n-i, sizeof(p[0]));
+//
+// Permutation rank / unrank
+//
+// Work on the remaining values, sorted. The number of distinct permutations
+// of m values that start with a value that appears c times is total*c/m,
+// where total counts permutations of all m values.
+//
+
+// a*b/c where the result is known to be an integer, UINT64_MAX on overflow
+static uint64_t _gca_muldiv(uint64_t a, uint64_t b, uint64_t c)
+{
+  uint64_t g = gca_calc_GCD64(b, c);
+  b /= g; c /= g; // now c divides a
+  a /= c;
+  return a > UINT64_MAX / b ? UINT64_MAX : a * b;
+}
+
+// Count distinct permutations of sorted values v, or n distinct values if NULL
+static uint64_t _gca_perm_count_sorted(const size_t *v, size_t n)
+{
+  uint64_t total = 1;
+  size_t i, run = 0;
+  for(i = 0; i < n && total != UINT64_MAX; i++) {
+    run = (v && i && v[i] == v[i-1]) ? run+1 : 1;
+    total = _gca_muldiv(total, i+1, run);
+  }
+  return total;
+}
+
+// Sorted copy of init, or 0..n-1, and the number of distinct permutations
+static size_t* _gca_perm_values(const size_t *init, size_t n, uint64_t *total)
+{
+  size_t i, *v = malloc(n * sizeof(size_t));
+  if(!v) return NULL;
+  if(init) {
+    memcpy(v, init, n * sizeof(size_t));
+    qsort(v, n, sizeof(size_t), gca_cmp_size);
+    *total = _gca_perm_count_sorted(v, n);
+  }
+  else {
+    for(i = 0; i < n; i++) v[i] = i;
+    *total = _gca_perm_count_sorted(NULL, n);
+  }
+  return v;
+}
+
+uint64_t gca_perm_count(const size_t *init, size_t n)
+{
+  if(!init) return _gca_perm_count_sorted(NULL, n);
+  uint64_t total = UINT64_MAX;
+  free(_gca_perm_values(init, n, &total));
+  return total;
+}
+
+uint64_t gca_perm_rank(const size_t *p, size_t n)
+{
+  uint64_t rank = 0, total;
+  size_t i, j, k, m, *v = _gca_perm_values(p, n, &total);
+  if(!v) return UINT64_MAX;
+  if(total == UINT64_MAX) { free(v); return UINT64_MAX; } // count was capped
+
+  for(i = 0, m = n; i < n; i++, m--) {
+    // count permutations starting with each smaller value
+    for(j = 0; v[j] != p[i]; j = k) {
+      for(k = j+1; k < m && v[k] == v[j]; k++) {}
+      rank += _gca_muldiv(total, k-j, m);
+    }
+    for(k = j+1; k < m && v[k] == v[j]; k++) {}
+    total = _gca_muldiv(total, k-j, m);
+    memmove(v+j, v+j+1, (m-j-1) * sizeof(size_t));
+  }
+
+  free(v);
+  return rank;
+}
+
+size_t* gca_perm_unrank(size_t *p, size_t n, uint64_t rank,
+                        const size_t *init)
+{
+  uint64_t total, sub;
+  size_t i, j, k, m, *v = _gca_perm_values(init, n, &total);
+  if(!v) return NULL;
+  // total == UINT64_MAX if the count was capped, so block sizes are unknown
+  if(rank >= total || total == UINT64_MAX) { free(v); return NULL; }
+
+  for(i = 0, m = n; i < n; i++, m--) {
+    // skip over blocks of permutations starting with smaller values
+    for(j = 0; ; j = k) {
+      for(k = j+1; k < m && v[k] == v[j]; k++) {}
+      sub = _gca_muldiv(total, k-j, m);
+      if(rank < sub) break;
+      rank -= sub;
+    }
+    p[i] = v[j];
+    total = sub;
+    memmove(v+j, v+j+1, (m-j-1) * sizeof(size_t));
+  }
+
+  free(v);
+  return p;
+}
+
+size_t* gca_itr_range(size_t **pp, size_t n, const size_t *init,
+                      uint64_t *rank, uint64_t end)
+{
+  size_t *p = *pp;
+
+  if(!n || *rank >= end) return NULL;
+  if(!*pp) {
+    p = *pp = malloc(n * sizeof(size_t));
+    p[0] = SIZE_MAX;
+  }
+  if(p[0] == SIZE_MAX) {
+    if(!gca_perm_unrank(p, n, *rank, init)) return NULL;
+  }
+  else if(!_gca_perm_next(p, n)) return NULL;
 
+  (*rank)++;
   return p;
 }
+
+//
+// Constant amortised time permutations
+//
+
+// Heap's algorithm. State is counters c[0..n-1] then the level i. c[0] is
+// always zero after the first call, so SIZE_MAX there means not started.
+static bool _gca_heap_step(size_t *c, size_t n, void *base, size_t es)
+{
+  char *b = (char*)base;
+  size_t i = c[n];
+  while(i < n) {
+    if(c[i] < i) {
+      size_t j = (i & 1) ? c[i] : 0;
+      _gca_swap_es(b+es*j, b+es*i, es);
+      c[i]++;
+      c[n] = 1;
+      return true;
+    }
+    c[i++] = 0;
+  }
+  c[n] = n;
+  return false;
+}
+
+void* gca_itr_heap(size_t **pp, void *base, size_t n, size_t es)
+{
+  size_t *c = *pp;
+  if(!n) return NULL;
+  if(!c) {
+    c = *pp = malloc((n+1) * sizeof(size_t));
+    c[0] = SIZE_MAX;
+  }
+  if(c[0] == SIZE_MAX) {
+    memset(c, 0, n * sizeof(size_t));
+    c[n] = 1;
+    return base;
+  }
+  return _gca_heap_step(c, n, base, es) ? base : NULL;
+}
+
+// Algorithm P with 0-based j. State is c[0..n-1] then o[0..n-1] (1 for +1,
+// 0 for -1). c[0] is always 0 while running; SIZE_MAX means not started and
+// SIZE_MAX-1 means finished.
+void* gca_itr_sjt(size_t **pp, void *base, size_t n, size_t es)
+{
+  char *b = (char*)base;
+  size_t *c = *pp, *o, j, s = 0, q;
+  if(!n) return NULL;
+  if(!c) {
+    c = *pp = malloc(2 * n * sizeof(size_t));
+    c[0] = SIZE_MAX;
+  }
+  o = c + n;
+  if(c[0] == SIZE_MAX) {
+    for(j = 0; j < n; j++) { c[j] = 0; o[j] = 1; }
+    return base;
+  }
+  if(c[0] == SIZE_MAX-1) return NULL;
+
+  for(j = n-1; ; j--) {
+    // element j+1 (of 1..n) moves within its range 0..j
+    q = o[j] ? c[j]+1 : c[j]-1;
+    if(o[j] ? q <= j : c[j] > 0) {
+      _gca_swap_es(b+es*(j-c[j]+s), b+es*(j-q+s), es);
+      c[j] = q;
+      return base;
+    }
+    if(o[j]) {
+      // reached the end of its range
+      if(j == 0) { c[0] = SIZE_MAX-1; return NULL; }
+      s++;
+    }
+    o[j] = !o[j];
+  }
+}
+
+// Algorithm R, 1-based: c[1..t] and c[t+1] = n are stored at p[0..t].
+// Returns false when done
+static bool _gca_comb_step(size_t *p, size_t t)
+{
+  size_t *c = p-1, j;
+  bool dec = t & 1; // odd t starts by trying to decrease c[2]
+  if(t == 0) return false;
+  if(dec ? c[1]+1 < c[2] : c[1] > 0) {
+    if(dec) c[1]++;
+    else c[1]--;
+    return true;
+  }
+  for(j = 2; j <= t; j++, dec = true) {
+    if(dec) {
+      // try to decrease c[j]
+      if(c[j] >= j) { c[j] = c[j-1]; c[j-1] = j-2; return true; }
+      if(++j > t) break;
+    }
+    // try to increase c[j]
+    if(c[j]+1 < c[j+1]) { c[j-1] = c[j]; c[j]++; return true; }
+  }
+  return false;
+}
+
+// p[k] is SIZE_MAX-1 once finished
+size_t* gca_itr_comb(size_t **pp, size_t n, size_t k)
+{
+  size_t i, *p = *pp;
+  assert(k <= n);
+  if(!p) {
+    p = *pp = malloc((k+1) * sizeof(size_t));
+    p[0] = SIZE_MAX;
+  }
+  if(p[0] == SIZE_MAX) {
+    for(i = 0; i < k; i++) p[i] = i;
+    p[k] = n;
+    return p;
+  }
+  if(p[k] != n) return NULL;
+  if(_gca_comb_step(p, k)) return p;
+  p[k] = SIZE_MAX-1;
+  return NULL;
+}
+
+// State: Heap's counters hc[0..k], the output perm, then the combination.
+// hc[0] is SIZE_MAX if not started
+size_t* gca_itr_kperm(size_t **pp, size_t n, size_t k)
+{
+  size_t *hc = *pp, *out, *comb;
+  assert(k <= n);
+  if(!hc) {
+    hc = *pp = malloc((3*k+2) * sizeof(size_t));
+    hc[0] = SIZE_MAX;
+  }
+  out = hc + k+1;
+  comb = hc + 2*k+1;
+
+  if(hc[0] == SIZE_MAX) {
+    gca_itr_reset(comb, 1);
+    gca_itr_comb(&comb, n, k);
+  }
+  else {
+    if(k && _gca_heap_step(hc, k, out, sizeof(size_t))) return out;
+    if(!gca_itr_comb(&comb, n, k)) return NULL;
+  }
+
+  // new combination: start on its permutations
+  memcpy(out, comb, k * sizeof(size_t));
+  memset(hc, 0, k * sizeof(size_t));
+  hc[k] = 1;
+  return out;
+}
@@ -13,6 +13,14 @@
 #include <inttypes.h>
 #include <stdbool.h>
 
+#if defined(__unix__) || defined(__APPLE__)
+  #include <unistd.h> // sysconf()
+  #include <sys/mman.h> // madvise()
+  #ifdef MADV_DONTNEED // hidden by strict feature test macros
+    #define GCA_MADVISE_SUPPORTED 1
+  #endif
+#endif
+
 
 static inline uint32_t gca_roundup32(uint32_t x) {
   return (--x, x|=x>>1, x|=x>>2, x|=x>>4, x|=x>>8, x|=x>>16, ++x);
@@ -44,6 +52,75 @@ static inline void* gca_capacity(void *ptr, size_t *size, size_t es,
 #define gca_resize(b, n, new_n) \
   do { (b) = gca_capacity(b, &(n), sizeof((b)[0]), (new_n)); } while(0)
 
+//
+// Shrinking
+//
+// Arrays only shrink when asked to. A GcaShrink policy says when: once fewer
+// than 1/factor of the slots are used, shrink to the smallest power of two
+// that is at least twice the number used (and at least minsize). Since the
+// array is then at most half full, growing and shrinking are amortised O(1)
+// for any factor >= 2; larger factors keep more memory and reallocate less.
+//
+// With madvise set, memory is not realloc'd. Instead the whole pages past the
+// new size are handed back to the OS with madvise(MADV_DONTNEED). The array
+// keeps its address and growing back up to the old size is cheap, but pages
+// at the edge of the used region stay resident.
+//
+
+typedef struct
+{
+  size_t minsize; // never shrink below this many elements
+  size_t factor; // shrink when n*factor < size, 0 to never shrink
+  bool madvise; // release pages instead of calling realloc
+} GcaShrink;
+
+// Hand the whole pages in ptr[0..nbytes-1] back to the OS. Their contents
+// read as zero on next use. Does nothing where madvise is not supported.
+static inline void gca_release_pages(void *ptr, size_t nbytes)
+{
+#ifdef GCA_MADVISE_SUPPORTED
+  uintptr_t page = sysconf(_SC_PAGESIZE);
+  uintptr_t beg = ((uintptr_t)ptr + page-1) & ~(page-1);
+  uintptr_t end = ((uintptr_t)ptr + nbytes) & ~(page-1);
+  if(beg < end) madvise((void*)beg, end-beg, MADV_DONTNEED);
+#else
+  (void)ptr; (void)nbytes;
+#endif
+}
+
+// Shrink an array to new_size elements, if that is smaller than *size
+// Returns the array, which may have moved
+static inline void* gca_shrink_to(void *ptr, size_t *size, size_t es,
+                                  size_t new_size, bool release)
+{
+  void *newptr;
+  if(!new_size) new_size = 1;
+  if(new_size >= *size) return ptr;
+#ifdef GCA_MADVISE_SUPPORTED
+  if(release) {
+    gca_release_pages((char*)ptr + es*new_size, es*(*size - new_size));
+    *size = new_size;
+    return ptr;
+  }
+#else
+  (void)release;
+#endif
+  // shrinking realloc may fail; the old block is still valid then
+  if((newptr = realloc(ptr, new_size * es)) == NULL) return ptr;
+  *size = new_size;
+  return newptr;
+}
+
+// Shrink an array holding n elements if the policy says so
+// Returns the array, which may have moved
+static inline void* gca_shrink(void *ptr, size_t *size, size_t es, size_t n,
+                               GcaShrink p)
+{
+  if(!p.factor || n * p.factor >= *size) return ptr;
+  size_t new_size = gca_roundup64(2*n > p.minsize ? 2*n : p.minsize);
+  return gca_shrink_to(ptr, size, es, new_size, p.madvise);
+}
+
 // comparison returns:
 //   negative iff a < b
 //          0 iff a == b
@@ -113,6 +190,7 @@ searchfunc(gca_search_charptr, char *const, strcmp);
 // Get Greatest Common Divisor using binary GCD algorithm
 // http://en.wikipedia.org/wiki/Binary_GCD_algorithm
 uint32_t gca_calc_GCD(uint32_t a, uint32_t b);
+uint64_t gca_calc_GCD64(uint64_t a, uint64_t b);
 
 static inline void gca_swapm(void *aa, void *bb, size_t es)
 {
@@ -123,11 +201,92 @@ static inline void gca_swapm(void *aa, void *bb, size_t es)
 // cyclic-shift an array by `shift` elements
 // cycle left shifts towards zero
 void gca_cycle_left(void *_ptr, size_t n, size_t es, size_t shift);
+// gca_cycle_left() swaps blocks until the smaller side fits in this many bytes,
+// then copies it through a stack buffer
+#ifndef GCA_CYCLE_BUF
+  #define GCA_CYCLE_BUF 512
+#endif
+// Specific methods: block swap only, three reversals, GCD juggling
+void gca_cycle_left_swap(void *_ptr, size_t n, size_t es, size_t shift);
+void gca_cycle_left_reverse(void *_ptr, size_t n, size_t es, size_t shift);
+void gca_cycle_left_juggle(void *_ptr, size_t n, size_t es, size_t shift);
 // cycle right shifts away from zero
 void gca_cycle_right(void *_ptr, size_t n, size_t es, size_t shift);
 
 // Reverse order of elements in an array
 void gca_reverse(void *_ptr, size_t n, size_t es);
+// Swap a[i] with b[n-1-i] for i < n. a[0..n-1] and b[0..n-1] must not overlap
+void gca_swap_reversed(void *a, void *b, size_t n, size_t es);
+
+//
+// Random numbers
+//
+// GcaRand is a xoshiro256** generator (http://prng.di.unimi.it/) with 256 bits
+// of state. It is not thread safe; give each thread its own state.
+// gca_rand_jump() advances a state by 2^128 draws, to split one seed into
+// non-overlapping streams.
+//
+
+typedef struct { uint64_t s[4]; } GcaRand;
+
+static inline uint64_t _gca_rotl(uint64_t x, int k) {
+  return (x << k) | (x >> (64 - k));
+}
+
+// Seed state from a 64 bit integer, using splitmix64 to fill the state
+static inline void gca_rand_seed(GcaRand *r, uint64_t seed)
+{
+  int i;
+  uint64_t z;
+  for(i = 0; i < 4; i++) {
+    z = (seed += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    r->s[i] = z ^ (z >> 31);
+  }
+}
+
+// Uniform random 64 bit integer
+static inline uint64_t gca_rand_next(GcaRand *r)
+{
+  uint64_t *s = r->s, result = _gca_rotl(s[1] * 5, 7) * 9, t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = _gca_rotl(s[3], 45);
+  return result;
+}
+
+// Uniform random integer in [0, n), n > 0
+// Lemire's nearly divisionless method: https://arxiv.org/abs/1805.10941
+static inline uint64_t gca_rand_bounded(GcaRand *r, uint64_t n)
+{
+#ifdef __SIZEOF_INT128__
+  __uint128_t m = (__uint128_t)gca_rand_next(r) * n;
+  uint64_t l = (uint64_t)m, t;
+  if(l < n) {
+    for(t = -n % n; l < t; l = (uint64_t)m)
+      m = (__uint128_t)gca_rand_next(r) * n;
+  }
+  return (uint64_t)(m >> 64);
+#else
+  // reject values from the last, incomplete, multiple of n
+  uint64_t x, lim = UINT64_MAX - UINT64_MAX % n;
+  while((x = gca_rand_next(r)) >= lim) {}
+  return x % n;
+#endif
+}
+
+// Uniform random double in [0, 1)
+static inline double gca_rand_double(GcaRand *r)
+{
+  return (gca_rand_next(r) >> 11) * 0x1.0p-53;
+}
+
+// Advance state by 2^128 calls to gca_rand_next()
+void gca_rand_jump(GcaRand *r);
 
 // Shuffle entire array
 // Fisher-Yates shuffle. Initiate srand() before calling.
@@ -137,6 +296,94 @@ void gca_shuffle(void *_ptr, size_t n, size_t es);
 // Fisher-Yates shuffle. Initiate srand() before calling.
 void gca_sample(void *base, size_t n, size_t es, size_t m);
 
+// Versions of shuffle and sample that draw from r, safe to call from many
+// threads if each uses its own GcaRand
+void gca_shuffle_r(void *base, size_t n, size_t es, GcaRand *r);
+void gca_sample_r(void *base, size_t n, size_t es, size_t m, GcaRand *r);
+
+//
+// Sampling without touching the input
+//
+// GcaReservoir keeps a uniform random sample of up to m elements from a stream
+// of unknown length, using Vitter's Algorithm L: after the first m elements it
+// draws how many to skip before the next one enters the sample, so most
+// elements are never looked at. Expected cost is O(m(1 + log(n/m))).
+// The sample is in no particular order; shuffle it if order matters.
+//
+
+typedef struct
+{
+  char *b; // sample of up to m elements, supplied by the caller
+  size_t es, m; // element size, sample size
+  size_t n; // number of elements seen
+  size_t next; // index of the next element to enter the sample
+  double w;
+  GcaRand *r;
+} GcaReservoir;
+
+// Number of elements in the sample
+#define gca_reservoir_size(rs) ((rs)->n < (rs)->m ? (rs)->n : (rs)->m)
+
+// buf must have space for m elements of size es
+void gca_reservoir_init(GcaReservoir *rs, void *buf, size_t es, size_t m,
+                        GcaRand *r);
+// Feed one element, or a block of n elements, from the stream
+void gca_reservoir_add(GcaReservoir *rs, const void *ptr);
+void gca_reservoir_add_n(GcaReservoir *rs, const void *ptr, size_t n);
+
+// Copy a uniform random sample of min(n,m) elements from base to out, reading
+// only the elements that are picked, in order. Returns number copied.
+size_t gca_sample_copy(const void *base, size_t n, size_t es, size_t m,
+                       void *out, GcaRand *r);
+
+// Write m distinct indices in [0,n) to idx, chosen uniformly at random.
+// Floyd's algorithm: O(m) time and memory, however large n is. m <= n.
+// Indices are in no particular order.
+void gca_sample_idx(size_t *idx, size_t n, size_t m, GcaRand *r);
+
+//
+// Weighted sampling
+//
+// GcaAlias is a table for drawing from a fixed discrete distribution in O(1)
+// per draw, using Vose's alias method. Each column i is picked uniformly,
+// then gives either i or its alias. Built in O(n) from non-negative weights.
+//
+
+typedef struct
+{
+  uint64_t thresh; // keep i if 53 random bits are below this
+  size_t alias; // otherwise return alias
+} GcaAliasCol;
+
+typedef struct
+{
+  size_t n;
+  GcaAliasCol *cols;
+} GcaAlias;
+
+// Returns false if the weights do not have a positive finite sum, or if out
+// of memory. Weights need not add up to one.
+bool gca_alias_alloc(GcaAlias *t, const double *w, size_t n);
+void gca_alias_dealloc(GcaAlias *t);
+
+// Index in [0,n), drawn with probability proportional to its weight
+static inline size_t gca_alias_draw(const GcaAlias *t, GcaRand *r)
+{
+  size_t i = gca_rand_bounded(r, t->n);
+  return (gca_rand_next(r) >> 11) < t->cols[i].thresh ? i : t->cols[i].alias;
+}
+
+// Write m draws to out
+void gca_alias_draw_n(const GcaAlias *t, size_t *out, size_t m, GcaRand *r);
+
+// Weighted sample without replacement: write up to m distinct indices to idx,
+// picking i with probability proportional to w[i] from those not yet picked.
+// Indices with weight <= 0 are never picked. Returns the number written.
+// Efraimidis-Spirakis: keep the m largest of u^(1/w[i]) in a heap. Indices are
+// in the order they would be drawn one at a time. O(n log m) time.
+size_t gca_sample_weighted(size_t *idx, const double *w, size_t n, size_t m,
+                           GcaRand *r);
+
 //
 // Permutations
 //
@@ -165,6 +412,72 @@ void gca_sample(void *base, size_t n, size_t es, size_t m);
 size_t* gca_itr_reset(size_t *p, size_t n);
 size_t* gca_itr_next(size_t **pp, size_t n, size_t *init);
 
+/*
+ * Permutations are numbered in the order gca_itr_next() visits them, starting
+ * from the sorted values: 0 .. gca_perm_count()-1. Duplicate values (as with
+ * the `init` array above) are counted once per distinct permutation. Ranks are
+ * 64 bit, which covers every permutation of up to 20 distinct values.
+ *
+ * Split the permutations of n values between threads:
+
+  uint64_t total = gca_perm_count(NULL, n), rank = total/nthreads*t;
+  uint64_t end = t+1 == nthreads ? total : total/nthreads*(t+1);
+  size_t *p = NULL;
+
+  while(gca_itr_range(&p, n, NULL, &rank, end))
+    ...
+
+  free(p);
+
+*/
+
+// Number of distinct permutations of init[0..n-1], or of 0..n-1 if init is
+// NULL. Returns UINT64_MAX if there are too many to count.
+uint64_t gca_perm_count(const size_t *init, size_t n);
+
+// Rank of permutation p among the distinct permutations of its values.
+// Returns UINT64_MAX if gca_perm_count() of its values would.
+uint64_t gca_perm_rank(const size_t *p, size_t n);
+
+// Write the permutation with the given rank to p. Values are those of init,
+// or 0..n-1 if init is NULL. Returns p, or NULL if rank is out of range or
+// there are too many permutations to count.
+size_t* gca_perm_unrank(size_t *p, size_t n, uint64_t rank,
+                        const size_t *init);
+
+// Iterate over permutations *rank .. end-1. Allocates *pp if NULL, reset with
+// gca_itr_reset() to start a new range. Increments *rank on each call.
+size_t* gca_itr_range(size_t **pp, size_t n, const size_t *init,
+                      uint64_t *rank, uint64_t end);
+
+/*
+ * Constant amortised time generators. These permute the data array in place
+ * with one swap per step, rather than returning indices. Not in lexicographic
+ * order. *pp holds the iterator state: set it to NULL to start, and free() it
+ * when done. gca_itr_reset(state, n) restarts an existing state, but never
+ * pass it NULL here: it would allocate n words and these need more. Free the
+ * state and set it to NULL instead.
+ *
+  size_t *state = NULL;
+  while(gca_itr_heap(&state, arr, n, sizeof(arr[0])))
+    ... // arr holds the next permutation
+  free(state);
+*/
+
+// Heap's algorithm: each step swaps two elements
+void* gca_itr_heap(size_t **pp, void *base, size_t n, size_t es);
+// Plain changes (Steinhaus-Johnson-Trotter): each step swaps two adjacent
+// elements. Knuth's Algorithm P (TAOCP 7.2.1.2).
+void* gca_itr_sjt(size_t **pp, void *base, size_t n, size_t es);
+
+// k-combinations of 0..n-1 in revolving door order: each step removes one
+// index and adds another. Returns k sorted indices. Knuth's Algorithm R
+// (TAOCP 7.2.1.3). k <= n
+size_t* gca_itr_comb(size_t **pp, size_t n, size_t k);
+// k-permutations of 0..n-1: all orders of each k-combination, using Heap's
+// algorithm. Returns k indices. k <= n
+size_t* gca_itr_kperm(size_t **pp, size_t n, size_t k);
+
 //
 // binary search
 //
@@ -235,6 +548,47 @@ void* gca_qselect(void *base, size_t nel, size_t es, size_t kidx,
 #define gca_median_float(base,nel)  gca_median2(base,nel,gca_cmp2_float, NULL,float,   gca_ab_mean_real,0.0)
 #define gca_median_double(base,nel) gca_median2(base,nel,gca_cmp2_double,NULL,double,  gca_ab_mean_real,0.0)
 
+//
+// Selection without reordering the input
+//
+// gca_qselect() reorders the array it searches. These functions only read it,
+// so they work on const or mmapped data. Extra memory is about 8*sqrt(nel)
+// elements, with a minimum of GCA_SELECT_RO_MIN. Smaller arrays are simply
+// copied. Larger ones are narrowed in a few passes. Each pass reads the whole
+// array and keeps a random sample of the elements between two bounds. The
+// next bounds are picked from that sample either side of the wanted rank.
+// When the elements between the bounds fit in memory, they are copied out
+// and quickselected. Big arrays usually take two passes.
+// If malloc fails they still work, with O(log nel) passes and no heap memory.
+//
+
+#ifndef GCA_SELECT_RO_MIN
+  #define GCA_SELECT_RO_MIN 1024
+#endif
+
+// Copy the kidx-th smallest element to out. Returns out.
+void* gca_select_ro(const void *base, size_t nel, size_t es, size_t kidx,
+                    int (*compar)(const void *_a, const void *_b, void *_arg),
+                    void *arg, void *out);
+
+// Copy the kidx-th and (kidx+1)-th smallest elements to out, which must have
+// space for two elements. kidx+1 < nel. Returns out.
+void* gca_select2_ro(const void *base, size_t nel, size_t es, size_t kidx,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg, void *out);
+
+// Median without reordering arr, returns 0 if n == 0.
+// Like gca_median_<type>() but only reads arr.
+#define medianrofunc(name,type_t) type_t gca_median_ro_##name(const type_t *arr, size_t n);
+medianrofunc(uint32, uint32_t)
+medianrofunc(uint64, uint64_t)
+medianrofunc(int,    int)
+medianrofunc(long,   long)
+medianrofunc(size,   size_t)
+medianrofunc(float,  float)
+medianrofunc(double, double)
+#undef medianrofunc
+
 //
 // Heapsort
 //
@@ -261,12 +615,87 @@ void gca_heap_sort(void *heap, size_t nel, size_t es,
                    int (*compar)(const void *_a, const void *_b, void *_arg),
                    void *arg);
 
+// Move the top of the heap to index nel-1, leaving a heap of nel-1 elements
+void gca_heap_pop(void *heap, size_t nel, size_t es,
+                  int (*compar)(const void *_a, const void *_b, void *_arg),
+                  void *arg);
+
 //
 // To heapsort an array:
 //   gca_heap_make(...)
 //   gca_heap_sort(...)
 //
 
+//
+// d-ary heaps (d = 4 or 8)
+//
+// Same calls as the binary heap above, with fewer levels to walk. The d
+// children of idx are at d*idx+1 .. d*idx+d. If `heap+es` is aligned to
+// d*es bytes (e.g. 64 bytes for d=8 and es=8) each set of siblings shares a
+// single cache line.
+//
+
+#define gca_heap4_parent(idx)  (((idx)-1)/4)
+#define gca_heap4_child(idx,k) (4*(idx)+1+(k))
+#define gca_heap8_parent(idx)  (((idx)-1)/8)
+#define gca_heap8_child(idx,k) (8*(idx)+1+(k))
+
+#define heapdfuncs(d)                                                          \
+void gca_heap##d##_pushup(void *heap, size_t nel, size_t es,                   \
+                          int (*compar)(const void *_a, const void *_b,        \
+                                        void *_arg),                           \
+                          void *arg);                                          \
+void gca_heap##d##_pushdwn(void *heap, size_t nel, size_t es,                  \
+                           int (*compar)(const void *_a, const void *_b,       \
+                                         void *_arg),                          \
+                           void *arg);                                         \
+void gca_heap##d##_make(void *base, size_t nel, size_t es,                     \
+                        int (*compar)(const void *_a, const void *_b,          \
+                                      void *_arg),                             \
+                        void *arg);                                            \
+void gca_heap##d##_sort(void *heap, size_t nel, size_t es,                     \
+                        int (*compar)(const void *_a, const void *_b,          \
+                                      void *_arg),                             \
+                        void *arg);                                            \
+void gca_heap##d##_pop(void *heap, size_t nel, size_t es,                      \
+                       int (*compar)(const void *_a, const void *_b,           \
+                                     void *_arg),                              \
+                       void *arg);
+heapdfuncs(4)
+heapdfuncs(8)
+#undef heapdfuncs
+
+//
+// Min-max heaps (double-ended priority queue)
+//
+// Even levels (including the root) are smaller than their descendants, odd
+// levels are larger. The min is at index 0, the max at index 1 or 2.
+//
+
+// New element at index nel-1, to be pushed up the heap
+void gca_mmheap_pushup(void *heap, size_t nel, size_t es,
+                       int (*compar)(const void *_a, const void *_b, void *_arg),
+                       void *arg);
+
+// Build a min-max heap in O(nel)
+void gca_mmheap_make(void *base, size_t nel, size_t es,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg);
+
+// Get pointer to min / max element. Undefined if nel == 0
+#define gca_mmheap_min(heap,nel,es,compar,arg) ((void*)(heap))
+void* gca_mmheap_max(void *heap, size_t nel, size_t es,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg);
+
+// Move the min / max element to index nel-1, leaving a heap of nel-1 elements
+void gca_mmheap_popmin(void *heap, size_t nel, size_t es,
+                       int (*compar)(const void *_a, const void *_b, void *_arg),
+                       void *arg);
+void gca_mmheap_popmax(void *heap, size_t nel, size_t es,
+                       int (*compar)(const void *_a, const void *_b, void *_arg),
+                       void *arg);
+
 //
 // Median
 //
@@ -352,6 +781,134 @@ void gca_merge(void *_dst, size_t ndst, size_t nsrc, size_t es,
                int (*compar)(const void *_a, const void *_b, void *_arg),
                void *arg);
 
+//
+// Sorted set operations
+//
+// Inputs are sorted by compar. Duplicates are kept the way std::set_* does.
+// If x is m times in a and n times in b, it is in the intersection min(m,n)
+// times, in the union max(m,n) times, and in the difference max(m-n,0)
+// times. Output elements are copied from a, except union elements only in b.
+// Runs a linear merge when the sizes are similar. When one input is more
+// than GCA_SET_GALLOP times the other, each element of the smaller input is
+// found in the larger one by galloping (exponential then binary search), so
+// the cost is O(m log(n/m)).
+// Each function returns the number of elements written to out.
+//
+
+#ifndef GCA_SET_GALLOP
+  #define GCA_SET_GALLOP 16
+#endif
+
+// Remove adjacent duplicates in place, keeping the first of each run of equal
+// elements. Returns the new length. Call after gca_qsort() for unique values.
+size_t gca_unique(void *base, size_t nel, size_t es,
+                  int (*compar)(const void *_a, const void *_b, void *_arg),
+                  void *arg);
+
+// out needs space for min(na,nb) elements. out may be a
+size_t gca_set_intersect(const void *a, size_t na, const void *b, size_t nb,
+                         size_t es,
+                         int (*compar)(const void *_a, const void *_b,
+                                       void *_arg),
+                         void *arg, void *out);
+
+// out needs space for na+nb elements and must not overlap a or b
+size_t gca_set_union(const void *a, size_t na, const void *b, size_t nb,
+                     size_t es,
+                     int (*compar)(const void *_a, const void *_b, void *_arg),
+                     void *arg, void *out);
+
+// Elements of a not in b. out needs space for na elements. out may be a
+size_t gca_set_diff(const void *a, size_t na, const void *b, size_t nb,
+                    size_t es,
+                    int (*compar)(const void *_a, const void *_b, void *_arg),
+                    void *arg, void *out);
+
+// Size of the intersection, without writing it
+size_t gca_set_count_intersect(const void *a, size_t na,
+                               const void *b, size_t nb, size_t es,
+                               int (*compar)(const void *_a, const void *_b,
+                                             void *_arg),
+                               void *arg);
+
+// Intersection of sets of uint32_t / uint64_t, e.g. sorted ID or posting
+// lists. Inputs must be strictly increasing (no duplicates). Compares blocks
+// of four from each input against each other with vector instructions.
+// out needs space for min(na,nb) elements. out may be a
+#define setfuncs(name,type_t)                                                  \
+size_t gca_set_intersect_##name(const type_t *a, size_t na,                    \
+                                const type_t *b, size_t nb, type_t *out);      \
+size_t gca_set_count_intersect_##name(const type_t *a, size_t na,              \
+                                      const type_t *b, size_t nb);
+setfuncs(uint32, uint32_t)
+setfuncs(uint64, uint64_t)
+#undef setfuncs
+
+//
+// K-way merge
+//
+// Merges k sorted runs in one pass with a loser tree (tournament tree). Each
+// internal node holds the run that lost the match played there, and tree[0]
+// holds the overall winner. After the winner's element is taken, only that
+// run replays its path from leaf to root, making one comparison per level:
+// ceil(log2(k)) comparisons per element. Equal elements come out in run
+// order, so the merge is stable.
+//
+// GcaMergeK merges runs that arrive in blocks, so inputs don't need to fit in
+// memory at once. fill(run, &block, fillarg) points block at the next
+// elements of run `run` and returns how many there are, or 0 once the run is
+// finished. A block must stay valid until fill is next called for its run.
+//
+
+typedef struct
+{
+  const char *ptr, *end; // rest of the current block, ptr is NULL when done
+} GcaMergeRun;
+
+// A run and a copy of its head pointer, which saves a load per comparison
+typedef struct
+{
+  size_t run;
+  const char *head;
+} GcaMergeNode;
+
+typedef struct
+{
+  size_t k, es;
+  GcaMergeNode *tree; // tree[0] is the winning run, tree[1..k-1] losers
+  GcaMergeRun *runs;
+  bool pending; // the winner was returned by gca_mergek_next(), not yet taken
+  int (*compar)(const void *_a, const void *_b, void *_arg);
+  void *arg;
+  size_t (*fill)(size_t _run, const void **_block, void *_fillarg);
+  void *fillarg;
+} GcaMergeK;
+
+// Merge k sorted runs of lens[i] elements into out, which needs space for the
+// sum of lens and must not overlap the runs.
+// Returns false if out of memory (O(k) is needed)
+bool gca_merge_k(const void *const runs[], const size_t lens[], size_t k,
+                 size_t es, void *out,
+                 int (*compar)(const void *_a, const void *_b, void *_arg),
+                 void *arg);
+
+// Calls fill for the first block of every run. Returns false if out of memory
+bool gca_mergek_alloc(GcaMergeK *m, size_t k, size_t es,
+                      int (*compar)(const void *_a, const void *_b, void *_arg),
+                      void *arg,
+                      size_t (*fill)(size_t _run, const void **_block,
+                                     void *_fillarg),
+                      void *fillarg);
+void gca_mergek_dealloc(GcaMergeK *m);
+
+// Next element in order, or NULL when all runs are finished. The pointer is
+// into a run's block and stays valid until the next call
+const void* gca_mergek_next(GcaMergeK *m);
+
+// Copy up to n next elements to out. Returns the number copied, less than n
+// only when all runs are finished
+size_t gca_mergek_read(GcaMergeK *m, void *out, size_t n);
+
 //
 // Check if an array is sorted
 //
@@ -379,6 +936,63 @@ static inline bool gca_is_rsorted(void *base, size_t nel, size_t es,
   return true;
 }
 
+// Get pointers to both the min and max entries in one pass, using about 1.5
+// comparisons per element instead of 2. Undefined if nel == 0
+static inline void gca_minmax(void *base, size_t nel, size_t es,
+                              int (*compar)(const void *_a, const void *_b,
+                                            void *_arg),
+                              void *arg, void **min, void **max)
+{
+  char *b = (char*)base, *end = b+es*nel, *ptr, *lo, *hi, *mn = b, *mx = b;
+  uintptr_t d;
+  int c;
+  // take elements in pairs: compare them, then the smaller with min and the
+  // larger with max. Ties go to the first, as in gca_min() / gca_max()
+  for(ptr = b + es*(1 + (nel & 1)); ptr < end; ptr += 2*es) {
+    c = compar(ptr-es, ptr, arg);
+    d = (uintptr_t)(ptr-es) ^ (uintptr_t)ptr;
+    lo = (char*)((uintptr_t)(ptr-es) ^ (d & -(uintptr_t)(c > 0)));
+    hi = (char*)((uintptr_t)ptr ^ (d & -(uintptr_t)(c >= 0)));
+    if(compar(lo, mn, arg) < 0) mn = lo;
+    if(compar(hi, mx, arg) > 0) mx = hi;
+  }
+  *min = mn;
+  *max = mx;
+}
+
+//
+// Typed reductions
+//
+// One pass over an array of a given type, with several independent
+// accumulators that the compiler turns into SIMD instructions. No function
+// pointer calls, and min and max come out of the same pass. Floating point
+// arrays must not contain NaNs.
+//
+//   gca_minmax_<type>(arr, n, &min, &max)  min and max, undefined if n == 0
+//   gca_argmin_<type>(arr, n)              index of the first min
+//   gca_argmax_<type>(arr, n)              index of the first max
+//   gca_sum_<type>(arr, n)                 sum, see below
+//
+// Sums of 32 bit integers are returned as 64 bit. 64 bit integer sums wrap.
+// float and double sums use pairwise summation in double precision, which
+// keeps rounding error O(log n) rather than O(n).
+//
+// type is one of: int32, uint32, int64, uint64, float, double
+//
+
+#define reducefuncs(name,type_t,sum_t)                                         \
+void gca_minmax_##name(const type_t *arr, size_t n, type_t *min, type_t *max); \
+size_t gca_argmin_##name(const type_t *arr, size_t n);                         \
+size_t gca_argmax_##name(const type_t *arr, size_t n);                         \
+sum_t gca_sum_##name(const type_t *arr, size_t n);
+reducefuncs(int32,  int32_t,  int64_t)
+reducefuncs(uint32, uint32_t, uint64_t)
+reducefuncs(int64,  int64_t,  int64_t)
+reducefuncs(uint64, uint64_t, uint64_t)
+reducefuncs(float,  float,    double)
+reducefuncs(double, double,   double)
+#undef reducefuncs
+
 // Get pointer to max entry using comparison function
 static inline void* gca_max(void *base, size_t nel, size_t es,
                             int (*compar)(const void *_a, const void *_b,
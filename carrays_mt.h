@@ -0,0 +1,239 @@
+#ifndef CARRAYS_MT_H_
+#define CARRAYS_MT_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h> // sysconf()
+
+#include "carrays.h"
+
+//
+// Multithreaded versions of array functions, for arrays too big for one core
+// to keep up with memory bandwidth. Each splits the work into independent
+// chunks and runs one chunk per thread, the calling thread included.
+//
+// nthreads == 0 uses one thread per online processor. Small arrays are
+// handled in the calling thread.
+// Compile with -pthread.
+//
+
+// Don't give a thread less than this many bytes to work on
+#ifndef GCA_MT_MIN_BYTES
+  #define GCA_MT_MIN_BYTES (1UL<<20)
+#endif
+
+static inline void gca_reverse_mt(void *_ptr, size_t n, size_t es,
+                                  size_t nthreads) __attribute__((unused));
+static inline void gca_shuffle_mt(void *base, size_t n, size_t es, GcaRand *r,
+                                  size_t nthreads) __attribute__((unused));
+
+// Number of threads to use for nbytes of work
+static inline size_t _gca_mt_nthreads(size_t nthreads, size_t nbytes)
+{
+  if(!nthreads) {
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = nproc > 0 ? nproc : 1;
+  }
+  size_t most = nbytes / GCA_MT_MIN_BYTES;
+  if(nthreads > most) nthreads = most;
+  return nthreads ? nthreads : 1;
+}
+
+// Run func(&args[i]) for i < nthreads, with args[0] in the calling thread
+static inline void _gca_mt_run(void *(*func)(void*), void *args, size_t argsize,
+                               size_t nthreads)
+{
+  pthread_t ths[nthreads];
+  size_t i, nstarted;
+  for(nstarted = 1; nstarted < nthreads; nstarted++)
+    if(pthread_create(&ths[nstarted], NULL, func,
+                      (char*)args + argsize*nstarted) != 0) break;
+  // if we couldn't start a thread, do its work here
+  for(i = nstarted; i < nthreads; i++) func((char*)args + argsize*i);
+  func(args);
+  for(i = 1; i < nstarted; i++) pthread_join(ths[i], NULL);
+}
+
+//
+// Reverse
+//
+
+typedef struct {
+  char *ptr;
+  size_t n, es, lo, hi; // swap pairs lo..hi-1
+} _GcaReverseJob;
+
+static inline void* _gca_reverse_job(void *arg)
+{
+  _GcaReverseJob *j = (_GcaReverseJob*)arg;
+  gca_swap_reversed(j->ptr + j->es*j->lo, j->ptr + j->es*(j->n - j->hi),
+                    j->hi - j->lo, j->es);
+  return NULL;
+}
+
+// Reverse order of elements in an array using multiple threads
+static inline void gca_reverse_mt(void *_ptr, size_t n, size_t es,
+                                  size_t nthreads)
+{
+  size_t i, npairs = n/2;
+  nthreads = _gca_mt_nthreads(nthreads, es*n);
+  if(nthreads == 1) { gca_reverse(_ptr, n, es); return; }
+
+  _GcaReverseJob jobs[nthreads];
+  for(i = 0; i < nthreads; i++) {
+    jobs[i] = (_GcaReverseJob){.ptr = (char*)_ptr, .n = n, .es = es,
+                               .lo = npairs*i/nthreads,
+                               .hi = npairs*(i+1)/nthreads};
+  }
+  _gca_mt_run(_gca_reverse_job, jobs, sizeof(jobs[0]), nthreads);
+}
+
+//
+// Shuffle
+//
+// Fisher-Yates makes a random access per element, which misses the cache on
+// every step for big arrays. Instead, scatter elements into random buckets
+// that each fit in cache, then Fisher-Yates each bucket:
+//
+//   1. each thread draws a random bucket for each element of its chunk and
+//      counts bucket sizes
+//   2. each thread copies its elements to their buckets in a temporary array.
+//      Buckets are laid out in order, thread by thread within each bucket
+//   3. each thread shuffles a range of buckets and copies them back
+//
+// Given the bucket sizes, the set of elements in each bucket is a uniformly
+// random subset of that size, so shuffling within buckets gives a uniformly
+// random permutation. Uses n*es + 2n bytes of temporary memory.
+//
+
+// Aim for buckets of this many bytes, small enough to stay in L2 cache
+#ifndef GCA_SHUFFLE_BUCKET_BYTES
+  #define GCA_SHUFFLE_BUCKET_BYTES (1UL<<18)
+#endif
+
+typedef struct {
+  char *base, *tmp;
+  size_t n, es, nthreads, nbuckets;
+  uint16_t *ids; // bucket of each element
+  size_t *counts; // counts[t*nbuckets+b], then the next write offset
+  size_t *bstart; // start of each bucket in tmp, nbuckets+1 entries
+} _GcaShuffle;
+
+typedef struct {
+  _GcaShuffle *sh;
+  size_t t, lo, hi; // thread number, elements lo..hi-1 (buckets in step 3)
+  GcaRand r;
+} _GcaShuffleJob;
+
+static inline void* _gca_shuffle_count(void *arg)
+{
+  _GcaShuffleJob *j = (_GcaShuffleJob*)arg;
+  _GcaShuffle *sh = j->sh;
+  size_t i, *counts = sh->counts + j->t * sh->nbuckets;
+  uint64_t x = 0, mask = sh->nbuckets-1;
+  uint16_t b;
+  // nbuckets is a power of two <= 2^16, so take four buckets per draw
+  for(i = j->lo; i < j->hi; i++, x >>= 16) {
+    if((i - j->lo) % 4 == 0) x = gca_rand_next(&j->r);
+    b = x & mask;
+    sh->ids[i] = b;
+    counts[b]++;
+  }
+  return NULL;
+}
+
+static inline void* _gca_shuffle_scatter(void *arg)
+{
+  _GcaShuffleJob *j = (_GcaShuffleJob*)arg;
+  _GcaShuffle *sh = j->sh;
+  size_t i, es = sh->es, *offs = sh->counts + j->t * sh->nbuckets;
+  const uint16_t *ids = sh->ids;
+  // fixed size copies for common sizes
+  #define _scatter_loop(size) \
+    for(i = j->lo; i < j->hi; i++) \
+      memcpy(sh->tmp + (size)*offs[ids[i]]++, sh->base + (size)*i, (size))
+  switch(es) {
+    case 4: _scatter_loop(4); break;
+    case 8: _scatter_loop(8); break;
+    default: _scatter_loop(es);
+  }
+  #undef _scatter_loop
+  return NULL;
+}
+
+static inline void* _gca_shuffle_buckets(void *arg)
+{
+  _GcaShuffleJob *j = (_GcaShuffleJob*)arg;
+  _GcaShuffle *sh = j->sh;
+  size_t b, es = sh->es, start, len;
+  for(b = j->lo; b < j->hi; b++) {
+    start = sh->bstart[b];
+    len = sh->bstart[b+1] - start;
+    gca_shuffle_r(sh->tmp + es*start, len, es, &j->r);
+    memcpy(sh->base + es*start, sh->tmp + es*start, es*len);
+  }
+  return NULL;
+}
+
+// Shuffle using multiple threads, with a cache friendly bucket scatter
+// Thread i draws from a copy of r jumped i times; r is left jumped nthreads
+// times, so the result is reproducible from r and nthreads.
+static inline void gca_shuffle_mt(void *base, size_t n, size_t es, GcaRand *r,
+                                  size_t nthreads)
+{
+  size_t b, t, nbuckets, off, target;
+  nthreads = _gca_mt_nthreads(nthreads, es*n);
+  nbuckets = gca_roundup64(es*n / GCA_SHUFFLE_BUCKET_BYTES + 1);
+  if(nbuckets > UINT16_MAX+1UL) nbuckets = UINT16_MAX+1UL;
+
+  _GcaShuffle sh = {.base = (char*)base, .n = n, .es = es,
+                    .nthreads = nthreads, .nbuckets = nbuckets};
+  if(nbuckets < 2 ||
+     !(sh.tmp = malloc(es*n)) ||
+     !(sh.ids = malloc(n * sizeof(uint16_t))) ||
+     !(sh.counts = calloc(nthreads*nbuckets, sizeof(size_t))) ||
+     !(sh.bstart = malloc((nbuckets+1) * sizeof(size_t))))
+  {
+    // fits in cache or out of memory
+    free(sh.tmp); free(sh.ids); free(sh.counts);
+    gca_shuffle_r(base, n, es, r);
+    return;
+  }
+
+  _GcaShuffleJob jobs[nthreads];
+  for(t = 0; t < nthreads; t++) {
+    jobs[t] = (_GcaShuffleJob){.sh = &sh, .t = t, .r = *r,
+                               .lo = n*t/nthreads, .hi = n*(t+1)/nthreads};
+    gca_rand_jump(r);
+  }
+  _gca_mt_run(_gca_shuffle_count, jobs, sizeof(jobs[0]), nthreads);
+
+  // turn counts into write offsets: bucket by bucket, thread by thread
+  for(b = off = 0; b < nbuckets; b++) {
+    sh.bstart[b] = off;
+    for(t = 0; t < nthreads; t++) {
+      size_t c = sh.counts[t*nbuckets+b];
+      sh.counts[t*nbuckets+b] = off;
+      off += c;
+    }
+  }
+  sh.bstart[nbuckets] = off;
+  _gca_mt_run(_gca_shuffle_scatter, jobs, sizeof(jobs[0]), nthreads);
+
+  // give each thread buckets holding about n/nthreads elements
+  for(t = 0, b = 0; t < nthreads; t++) {
+    jobs[t].lo = b;
+    target = n*(t+1)/nthreads;
+    while(b < nbuckets && (t+1 == nthreads || sh.bstart[b+1] <= target)) b++;
+    jobs[t].hi = b;
+  }
+  _gca_mt_run(_gca_shuffle_buckets, jobs, sizeof(jobs[0]), nthreads);
+
+  free(sh.tmp);
+  free(sh.ids);
+  free(sh.counts);
+  free(sh.bstart);
+}
+
+#endif /* CARRAYS_MT_H_ */
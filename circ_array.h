@@ -5,6 +5,18 @@
 #include <string.h>
 #include <assert.h>
 
+#ifdef __linux__
+  #include <unistd.h>
+  #include <sys/mman.h>
+  #include <sys/syscall.h>
+  #define CIRCA_MIRROR_SUPPORTED 1
+#endif
+
+#if defined(__unix__) || defined(__APPLE__)
+  #include <sys/uio.h> // readv(), writev()
+  #define CIRCA_FD_SUPPORTED 1
+#endif
+
 #include "carrays.h"
 
 //
@@ -23,28 +35,111 @@ typedef struct
   const size_t el; // element size in bytes
   size_t start, n, size, mask; // n<=size, mask=size-1
   void *b;
+  bool nozero; // if true, don't zero new elements
+  bool mirrored; // set by circa_alloc_mirror(): b maps fd twice
+  int fd; // memfd backing a mirrored buffer, unused otherwise
+  GcaShrink shrink; // when to shrink as elements are removed (default never)
 } CircBuf;
 
 static inline void circa_alloc(CircBuf *l, size_t el, size_t size) __attribute__((unused));
+static inline bool circa_alloc_mirror(CircBuf *l, size_t el, size_t size) __attribute__((unused));
 static inline void circa_dealloc(CircBuf *l) __attribute__((unused));
 static inline void circa_capacity(CircBuf *l, size_t s) __attribute__((unused));
+static inline void circa_shrink_to_fit(CircBuf *l) __attribute__((unused));
 static inline void* circa_push(CircBuf *l) __attribute__((unused));
 static inline void* circa_pop(CircBuf *l) __attribute__((unused));
 static inline void* circa_unshift(CircBuf *l) __attribute__((unused));
 static inline void* circa_shift(CircBuf *l) __attribute__((unused));
 static inline void circa_norm(CircBuf *l) __attribute__((unused));
+static inline size_t circa_spans(const CircBuf *l, size_t idx, size_t n,
+                                 void **seg1, void **seg2) __attribute__((unused));
+static inline void circa_push_n(CircBuf *l, const void *ptr, size_t n) __attribute__((unused));
+static inline void circa_append_n(CircBuf *l, const void *ptr, size_t n) __attribute__((unused));
+static inline size_t circa_pop_n(CircBuf *l, void *ptr, size_t n) __attribute__((unused));
+#ifdef CIRCA_FD_SUPPORTED
+static inline ssize_t circa_readv_fd(CircBuf *l, int fd, size_t max) __attribute__((unused));
+static inline ssize_t circa_writev_fd(CircBuf *l, int fd, size_t max) __attribute__((unused));
+#endif
 
 static inline void circa_alloc(CircBuf *l, size_t el, size_t size)
 {
   size = roundup64(size);
   CircBuf tmp = {.el = el, .start = 0, .n = 0,
                    .size = size, .mask = size-1,
-                   .b = malloc(size * el)};
+                   .b = malloc(size * el), .nozero = false,
+                   .mirrored = false, .fd = -1};
   memcpy(l, &tmp, sizeof(CircBuf));
 }
 
+//
+// Mirrored buffers (Linux only)
+//
+// The same memory is mapped twice, back to back, so the array never appears
+// to wrap: the n elements from circa_get(l,0) are always contiguous, as is any
+// window of up to l->size elements from circa_get(l,i). circa_norm() does
+// nothing. The size is rounded up so that size*el is a multiple of the page
+// size. Growing remaps the memory instead of realloc'ing it.
+//
+
+#ifdef CIRCA_MIRROR_SUPPORTED
+// Smallest power of two number of elements that fill whole pages
+static inline size_t _circa_mirror_minsize(size_t el)
+{
+  size_t page = sysconf(_SC_PAGESIZE), minsize;
+  for(minsize = 1; (minsize * el) % page; minsize <<= 1) {}
+  return minsize;
+}
+
+// Map `bytes` of fd twice, back to back. Returns NULL on failure.
+static inline char* _circa_mirror_map(int fd, size_t bytes)
+{
+  char *b = mmap(NULL, 2*bytes, PROT_NONE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+  if(b == MAP_FAILED) return NULL;
+  if(mmap(b, bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED ||
+     mmap(b+bytes, bytes, PROT_READ|PROT_WRITE, MAP_SHARED|MAP_FIXED, fd, 0) == MAP_FAILED)
+  {
+    munmap(b, 2*bytes);
+    return NULL;
+  }
+  return b;
+}
+#endif
+
+// Returns false if mirroring is not supported or failed; l is then unchanged
+static inline bool circa_alloc_mirror(CircBuf *l, size_t el, size_t size)
+{
+#ifdef CIRCA_MIRROR_SUPPORTED
+  size_t minsize = _circa_mirror_minsize(el);
+  size = roundup64(size < minsize ? minsize : size);
+
+  int fd = syscall(SYS_memfd_create, "circa", 0);
+  if(fd < 0) return false;
+  char *b = NULL;
+  if(ftruncate(fd, size * el) != 0 || (b = _circa_mirror_map(fd, size*el)) == NULL) {
+    close(fd);
+    return false;
+  }
+  CircBuf tmp = {.el = el, .start = 0, .n = 0,
+                   .size = size, .mask = size-1,
+                   .b = b, .nozero = false,
+                   .mirrored = true, .fd = fd};
+  memcpy(l, &tmp, sizeof(CircBuf));
+  return true;
+#else
+  (void)l; (void)el; (void)size;
+  return false;
+#endif
+}
+
 static inline void circa_dealloc(CircBuf *l)
 {
+#ifdef CIRCA_MIRROR_SUPPORTED
+  if(l->mirrored) {
+    munmap(l->b, 2 * l->size * l->el);
+    close(l->fd);
+    return;
+  }
+#endif
   free(l->b);
 }
 
@@ -53,12 +148,27 @@ static inline void circa_resize(CircBuf *l, size_t size)
   // resize is only for growing array and new size must be a power of two
   assert(size > l->size && (size & (size-1)) == 0);
 
+#ifdef CIRCA_MIRROR_SUPPORTED
+  if(l->mirrored) {
+    char *newb = NULL;
+    if(ftruncate(l->fd, size * l->el) != 0 ||
+       (newb = _circa_mirror_map(l->fd, size * l->el)) == NULL) abort();
+    munmap(l->b, 2 * l->size * l->el);
+    l->b = newb;
+  }
+  else
+#endif
   l->b = realloc(l->b, l->el*size);
+
+  char *b = (char*)l->b;
   if(l->start + l->n > l->size) {
     // nend is the num items at the end of the b, nbeg is at the beginning
-    size_t nend = l->size-l->start, nbeg = (l->start+l->n) & l->mask;
-    if(nend < nbeg) memmove(l->b+size-nend, l->b+l->size-nend, l->el*nend);
-    else            memmove(l->b+l->size, l->b, l->el*nbeg);
+    size_t nend = l->size-l->start, nbeg = l->start + l->n - l->size;
+    if(nend < nbeg) {
+      memmove(b+l->el*(size-nend), b+l->el*l->start, l->el*nend);
+      l->start = size-nend;
+    }
+    else memmove(b+l->el*l->size, b, l->el*nbeg);
   }
   l->size = size;
   l->mask = size-1;
@@ -69,8 +179,85 @@ static inline void circa_capacity(CircBuf *l, size_t size)
   if(size > l->size) circa_resize(l, roundup64(size));
 }
 
+// Move elements into the first `size` slots and give back the rest
+static inline void _circa_shrink(CircBuf *l, size_t size)
+{
+  // new size must be a power of two that holds all elements
+  assert(size >= l->n && size < l->size && (size & (size-1)) == 0);
+
+#ifdef CIRCA_MIRROR_SUPPORTED
+  char *newb = NULL;
+  if(l->mirrored) {
+    // map the smaller file before moving anything, so failure changes nothing
+    newb = _circa_mirror_map(l->fd, size * l->el);
+    if(newb == NULL) return; // keep the old mapping and size
+  }
+#endif
+
+  char *b = (char*)l->b;
+  if(l->n == 0) l->start = 0;
+  else if(l->start + l->n > l->size) {
+    // wrapped: move the items at the end of b to the end of the new buffer
+    size_t nend = l->size - l->start;
+    memmove(b+l->el*(size-nend), b+l->el*l->start, l->el*nend);
+    l->start = size-nend;
+  }
+  else if(l->start >= size || l->start + l->n > size) {
+    memmove(b, b+l->el*l->start, l->el*l->n);
+    l->start = 0;
+  }
+
+#ifdef CIRCA_MIRROR_SUPPORTED
+  if(l->mirrored) {
+    munmap(l->b, 2 * l->size * l->el);
+    if(ftruncate(l->fd, size * l->el) != 0) {} // only loses reclaimed memory
+    l->b = newb;
+  }
+  else
+#endif
+  {
+    size_t oldsize = l->size;
+    l->b = gca_shrink_to(l->b, &oldsize, l->el, size, l->shrink.madvise);
+  }
+
+  l->size = size;
+  l->mask = size-1;
+}
+
+// Smallest size a buffer may shrink to
+static inline size_t _circa_minsize(const CircBuf *l)
+{
+#ifdef CIRCA_MIRROR_SUPPORTED
+  if(l->mirrored) return _circa_mirror_minsize(l->el);
+#endif
+  return 1;
+}
+
+// Called before removing elements, when there will be n left. Shrinks if the
+// l->shrink policy says so. All l->n current elements are kept, so pointers
+// to the elements being removed are valid after they are removed.
+static inline void _circa_autoshrink(CircBuf *l, size_t n)
+{
+  if(!l->shrink.factor || n * l->shrink.factor >= l->size) return;
+  size_t size = 2*n, min = _circa_minsize(l);
+  if(size < l->shrink.minsize) size = l->shrink.minsize;
+  if(size < l->n) size = l->n;
+  if(size < min) size = min;
+  size = roundup64(size);
+  if(size < l->size) _circa_shrink(l, size);
+}
+
+// Shrink to the smallest power of two that holds all elements, ignoring
+// l->shrink except for its madvise setting
+static inline void circa_shrink_to_fit(CircBuf *l)
+{
+  size_t min = _circa_minsize(l);
+  size_t size = roundup64(l->n > min ? l->n : min);
+  if(size < l->size) _circa_shrink(l, size);
+}
+
 #define circa_pos(l,idx) (((l)->start + (idx)) & (l)->mask)
-#define circa_get(l,idx) ((l)->b + (l)->el * circa_pos(l,idx))
+#define circa_get(l,idx) ((void*)((char*)(l)->b + (l)->el * circa_pos(l,idx)))
 
 // Add to start
 // Returns a pointer to the item added (zero'd)
@@ -80,7 +267,7 @@ static inline void* circa_push(CircBuf *l)
   l->start = l->start ? l->start-1 : l->size-1;
   l->n++;
   void *ptr = circa_get(l, 0);
-  memset(ptr, 0, l->el);
+  if(!l->nozero) memset(ptr, 0, l->el);
   return ptr;
 }
 
@@ -89,10 +276,11 @@ static inline void* circa_push(CircBuf *l)
 static inline void* circa_pop(CircBuf *l)
 {
   assert(l->n > 0);
+  _circa_autoshrink(l, l->n-1);
   size_t old = l->start;
   l->start = (l->start+1) & l->mask;
   l->n--;
-  return l->b + l->el*old;
+  return (char*)l->b + l->el*old;
 }
 
 // Add to end
@@ -101,7 +289,7 @@ static inline void* circa_unshift(CircBuf *l)
 {
   if(l->n == l->size) circa_resize(l, l->size*2);
   void *ptr = circa_get(l, l->n);
-  memset(ptr, 0, l->el);
+  if(!l->nozero) memset(ptr, 0, l->el);
   l->n++;
   return ptr;
 }
@@ -111,7 +299,8 @@ static inline void* circa_unshift(CircBuf *l)
 static inline void* circa_shift(CircBuf *l)
 {
   assert(l->n > 0);
-  void *ptr = circa_get(l, l->n);
+  _circa_autoshrink(l, l->n-1);
+  void *ptr = circa_get(l, l->n-1);
   l->n--;
   return ptr;
 }
@@ -120,13 +309,14 @@ static inline void* circa_shift(CircBuf *l)
 static inline void circa_norm(CircBuf *l)
 {
   size_t newstart, nright, nleft;
-  if(l->start + l->n > l->size) {
+  char *b = (char*)l->b;
+  if(!l->mirrored && l->start + l->n > l->size) {
     newstart = (l->size - l->n) / 2; // pick a new start
     nleft = l->start + l->n - l->size;
     nright = l->size - l->start;
     if(nleft <= newstart) {
-      memmove(l->b+newstart, l->b+l->start, l->el * nright);
-      memcpy(l->b+newstart+nright, l->b, l->el * nleft);
+      memmove(b+l->el*newstart, b+l->el*l->start, l->el * nright);
+      memcpy(b+l->el*(newstart+nright), b, l->el * nleft);
     } else {
       // memset(l->b+nleft, 0, l->el*(l->size-l->n)); // silence valgrind warning
       gca_cycle_left(l->b, l->size, l->el, l->start-newstart);
@@ -135,4 +325,111 @@ static inline void circa_norm(CircBuf *l)
   }
 }
 
+// Get pointers to elements idx..idx+n-1, which are split in two if they wrap
+// around the end of the buffer. seg1 and seg2 may be NULL.
+// Returns number of elements in seg1, seg2 has the remaining n-(return value)
+static inline size_t circa_spans(const CircBuf *l, size_t idx, size_t n,
+                                 void **seg1, void **seg2)
+{
+  assert(idx + n <= l->n);
+  size_t pos = circa_pos(l, idx), n1 = l->size - pos < n ? l->size - pos : n;
+  if(seg1) *seg1 = (char*)l->b + l->el*pos;
+  if(seg2) *seg2 = l->b;
+  return n1;
+}
+
+// Copy n elements from ptr into idx..idx+n-1. If ptr is NULL, zero them
+// unless l->nozero is set.
+static inline void _circa_copy_in(CircBuf *l, size_t idx, const void *ptr,
+                                  size_t n)
+{
+  void *seg1, *seg2;
+  size_t n1 = circa_spans(l, idx, n, &seg1, &seg2);
+  if(ptr) {
+    memcpy(seg1, ptr, l->el*n1);
+    memcpy(seg2, (const char*)ptr + l->el*n1, l->el*(n-n1));
+  }
+  else if(!l->nozero) {
+    memset(seg1, 0, l->el*n1);
+    memset(seg2, 0, l->el*(n-n1));
+  }
+}
+
+// Add n elements to start, copied from ptr (or zero'd if ptr is NULL)
+// Afterwards element i is ptr[i]
+static inline void circa_push_n(CircBuf *l, const void *ptr, size_t n)
+{
+  circa_capacity(l, l->n+n);
+  l->start = (l->start + l->size - n) & l->mask;
+  l->n += n;
+  _circa_copy_in(l, 0, ptr, n);
+}
+
+// Add n elements to end, copied from ptr (or zero'd if ptr is NULL)
+static inline void circa_append_n(CircBuf *l, const void *ptr, size_t n)
+{
+  circa_capacity(l, l->n+n);
+  l->n += n;
+  _circa_copy_in(l, l->n-n, ptr, n);
+}
+
+// Remove up to n elements from start, copying them to ptr if not NULL
+// Returns number of elements removed
+static inline size_t circa_pop_n(CircBuf *l, void *ptr, size_t n)
+{
+  void *seg1, *seg2;
+  if(n > l->n) n = l->n;
+  if(ptr) {
+    size_t n1 = circa_spans(l, 0, n, &seg1, &seg2);
+    memcpy(ptr, seg1, l->el*n1);
+    memcpy((char*)ptr + l->el*n1, seg2, l->el*(n-n1));
+  }
+  l->start = (l->start + n) & l->mask;
+  l->n -= n;
+  _circa_autoshrink(l, l->n);
+  return n;
+}
+
+//
+// File / socket I/O (byte buffers only, el == 1)
+//
+// Data moves straight between the kernel and the buffer with one readv() /
+// writev() call, using an iovec for each of the (up to two) contiguous
+// blocks. Return values and errno are those of readv() / writev().
+//
+
+#ifdef CIRCA_FD_SUPPORTED
+// Read up to max bytes from fd onto the end, growing the buffer if needed
+static inline ssize_t circa_readv_fd(CircBuf *l, int fd, size_t max)
+{
+  assert(l->el == 1);
+  struct iovec iov[2];
+  circa_capacity(l, l->n + max);
+  size_t pos = circa_pos(l, l->n), n1 = l->size - pos;
+  if(n1 > max || l->mirrored) n1 = max; // mirrored buffers never wrap
+  iov[0].iov_base = (char*)l->b + pos;
+  iov[0].iov_len = n1;
+  iov[1].iov_base = l->b;
+  iov[1].iov_len = max - n1;
+  ssize_t r = readv(fd, iov, n1 < max ? 2 : 1);
+  if(r > 0) l->n += r;
+  return r;
+}
+
+// Write up to max bytes from the start to fd, removing those written
+static inline ssize_t circa_writev_fd(CircBuf *l, int fd, size_t max)
+{
+  assert(l->el == 1);
+  struct iovec iov[2];
+  if(max > l->n) max = l->n;
+  size_t n1 = circa_spans(l, 0, max, &iov[0].iov_base, &iov[1].iov_base);
+  if(l->mirrored) n1 = max;
+  iov[0].iov_len = n1;
+  iov[1].iov_len = max - n1;
+  ssize_t r = writev(fd, iov, n1 < max ? 2 : 1);
+  if(r > 0) circa_pop_n(l, NULL, r);
+  return r;
+}
+#endif
+
 #endif /* CIRC_ARRAY_H_ */
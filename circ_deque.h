@@ -0,0 +1,135 @@
+#ifndef CIRC_DEQUE_H_
+#define CIRC_DEQUE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "circ_array.h"
+
+//
+// Segmented circular array (block deque)
+//
+// Elements live in fixed-size blocks that never move, so pointers to elements
+// stay valid until the element is removed, and growing never copies element
+// data. A CircBuf of block pointers keeps the blocks in order. Adding an
+// element allocates at most one block; removing frees at most one.
+//
+// Like CircBuf, push/pop work on the start and unshift/shift on the end.
+//
+
+typedef struct
+{
+  const size_t el; // element size in bytes
+  const size_t bsize, bshift, bmask; // elements per block (power of two)
+  size_t off, n; // first element is at offset `off` in the first block
+  CircBuf blocks; // ring of block pointers
+  void *spare; // last block released, reused before calling malloc
+} CircDeque;
+
+static inline void circa_deque_alloc(CircDeque *d, size_t el, size_t bsize) __attribute__((unused));
+static inline void circa_deque_dealloc(CircDeque *d) __attribute__((unused));
+static inline void* circa_deque_push(CircDeque *d) __attribute__((unused));
+static inline void* circa_deque_pop(CircDeque *d) __attribute__((unused));
+static inline void* circa_deque_unshift(CircDeque *d) __attribute__((unused));
+static inline void* circa_deque_shift(CircDeque *d) __attribute__((unused));
+
+// bsize is the number of elements per block, rounded up to a power of two
+static inline void circa_deque_alloc(CircDeque *d, size_t el, size_t bsize)
+{
+  size_t bshift;
+  bsize = roundup64(bsize < 2 ? 2 : bsize);
+  for(bshift = 0; (1UL << bshift) < bsize; bshift++) {}
+  CircDeque tmp = {.el = el, .bsize = bsize, .bshift = bshift,
+                   .bmask = bsize-1, .off = 0, .n = 0, .spare = NULL};
+  memcpy(d, &tmp, sizeof(CircDeque));
+  circa_alloc(&d->blocks, sizeof(void*), 8);
+  d->blocks.nozero = true;
+}
+
+static inline void circa_deque_dealloc(CircDeque *d)
+{
+  size_t i;
+  for(i = 0; i < d->blocks.n; i++) free(*(void**)circa_get(&d->blocks, i));
+  circa_dealloc(&d->blocks);
+  free(d->spare);
+}
+
+// Get pointer to element idx
+static inline void* circa_deque_get(const CircDeque *d, size_t idx)
+{
+  size_t i = d->off + idx;
+  char *blk = *(char**)circa_get(&d->blocks, i >> d->bshift);
+  return blk + d->el * (i & d->bmask);
+}
+
+static inline void* _circa_deque_new_block(CircDeque *d)
+{
+  void *blk = d->spare ? d->spare : malloc(d->el * d->bsize);
+  d->spare = NULL;
+  return blk;
+}
+
+static inline void _circa_deque_release(CircDeque *d, void *blk)
+{
+  free(d->spare);
+  d->spare = blk;
+}
+
+// Add to start
+// Returns a pointer to the item added (zero'd)
+static inline void* circa_deque_push(CircDeque *d)
+{
+  if(d->off == 0) {
+    *(void**)circa_push(&d->blocks) = _circa_deque_new_block(d);
+    d->off = d->bsize;
+  }
+  d->off--;
+  d->n++;
+  void *ptr = circa_deque_get(d, 0);
+  memset(ptr, 0, d->el);
+  return ptr;
+}
+
+// Add to end
+// Returns a pointer to the item added (zero'd)
+static inline void* circa_deque_unshift(CircDeque *d)
+{
+  if(d->off + d->n == d->blocks.n << d->bshift)
+    *(void**)circa_unshift(&d->blocks) = _circa_deque_new_block(d);
+  d->n++;
+  void *ptr = circa_deque_get(d, d->n-1);
+  memset(ptr, 0, d->el);
+  return ptr;
+}
+
+// Remove from start
+// Returns a pointer to the item removed, valid until the deque is next changed
+static inline void* circa_deque_pop(CircDeque *d)
+{
+  assert(d->n > 0);
+  void *ptr = circa_deque_get(d, 0);
+  d->off++;
+  d->n--;
+  if(d->off == d->bsize || d->n == 0) {
+    _circa_deque_release(d, *(void**)circa_pop(&d->blocks));
+    d->off = 0;
+  }
+  return ptr;
+}
+
+// Remove from end
+// Returns a pointer to the item removed, valid until the deque is next changed
+static inline void* circa_deque_shift(CircDeque *d)
+{
+  assert(d->n > 0);
+  void *ptr = circa_deque_get(d, d->n-1);
+  d->n--;
+  if(d->n == 0 || ((d->off + d->n) & d->bmask) == 0) {
+    _circa_deque_release(d, *(void**)circa_shift(&d->blocks));
+    if(d->n == 0) d->off = 0;
+  }
+  return ptr;
+}
+
+#endif /* CIRC_DEQUE_H_ */
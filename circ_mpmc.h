@@ -0,0 +1,254 @@
+#ifndef CIRC_MPMC_H_
+#define CIRC_MPMC_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <assert.h>
+#include <sched.h> // sched_yield()
+
+#ifdef __linux__
+  #include <unistd.h>
+  #include <linux/futex.h>
+  #include <sys/syscall.h>
+#endif
+
+#include "carrays.h"
+
+//
+// Bounded multi-producer/multi-consumer circular array
+//
+// Fixed capacity (power of two, indexed with `mask` like CircBuf). Each slot
+// has a sequence number that says whether it is ready to be written (seq ==
+// pos) or read (seq == pos+1) on the current lap, so producers and consumers
+// only contend on the enq / deq counters. Dmitry Vyukov's bounded queue:
+// http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+//
+// try* calls never block. Blocking calls spin briefly and then either yield
+// or, if `futex` was set on alloc (Linux only), sleep until woken.
+//
+
+typedef struct
+{
+  uint32_t word; // bumped on every wake
+  uint32_t nwaiters;
+} CircMPMCWait;
+
+typedef struct
+{
+  size_t enq __attribute__((aligned(64))); // next position to write
+  size_t deq __attribute__((aligned(64))); // next position to read
+  CircMPMCWait notempty __attribute__((aligned(64))), notfull;
+
+  // read-only after alloc
+  size_t el __attribute__((aligned(64))); // element size in bytes
+  size_t size, mask, stride; // mask=size-1, stride=bytes per slot
+  bool futex;
+  char *b; // slots: [size_t seq][element]
+} CircMPMC;
+
+static inline void circa_mpmc_alloc(CircMPMC *q, size_t el, size_t size,
+                                    bool futex) __attribute__((unused));
+static inline void circa_mpmc_dealloc(CircMPMC *q) __attribute__((unused));
+static inline bool circa_mpmc_trypush(CircMPMC *q, const void *ptr) __attribute__((unused));
+static inline bool circa_mpmc_trypop(CircMPMC *q, void *ptr) __attribute__((unused));
+static inline size_t circa_mpmc_trypush_n(CircMPMC *q, const void *ptr, size_t n) __attribute__((unused));
+static inline size_t circa_mpmc_trypop_n(CircMPMC *q, void *ptr, size_t n) __attribute__((unused));
+static inline void circa_mpmc_push(CircMPMC *q, const void *ptr) __attribute__((unused));
+static inline void circa_mpmc_pop(CircMPMC *q, void *ptr) __attribute__((unused));
+static inline void circa_mpmc_push_n(CircMPMC *q, const void *ptr, size_t n) __attribute__((unused));
+static inline size_t circa_mpmc_pop_n(CircMPMC *q, void *ptr, size_t n) __attribute__((unused));
+
+#define _circa_mpmc_seq(q,pos) ((size_t*)((q)->b + (q)->stride * ((pos) & (q)->mask)))
+#define _circa_mpmc_data(q,pos) ((char*)_circa_mpmc_seq(q,pos) + sizeof(size_t))
+
+static inline void circa_mpmc_alloc(CircMPMC *q, size_t el, size_t size,
+                                    bool futex)
+{
+  size_t i;
+  size = gca_roundup64(size < 2 ? 2 : size);
+  memset(q, 0, sizeof(CircMPMC));
+  q->el = el;
+  q->size = size;
+  q->mask = size-1;
+  q->stride = (sizeof(size_t) + el + sizeof(size_t)-1) & ~(sizeof(size_t)-1);
+  q->futex = futex;
+  q->b = malloc(size * q->stride);
+  for(i = 0; i < size; i++) *_circa_mpmc_seq(q, i) = i;
+}
+
+static inline void circa_mpmc_dealloc(CircMPMC *q)
+{
+  free(q->b);
+}
+
+//
+// Non-blocking
+//
+
+static inline size_t _circa_mpmc_trypush_n(CircMPMC *q, const void *ptr, size_t n)
+{
+  const char *src = (const char*)ptr;
+  size_t pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED), i;
+  intptr_t dif;
+
+  if(!n) return 0;
+  while(1) {
+    dif = (intptr_t)__atomic_load_n(_circa_mpmc_seq(q, pos), __ATOMIC_ACQUIRE)
+          - (intptr_t)pos;
+    if(dif < 0) return 0; // full
+    if(dif > 0) { pos = __atomic_load_n(&q->enq, __ATOMIC_RELAXED); continue; }
+    // count consecutive free slots, they stay free until we claim them
+    for(i = 1; i < n && __atomic_load_n(_circa_mpmc_seq(q, pos+i),
+                                        __ATOMIC_ACQUIRE) == pos+i; i++) {}
+    if(__atomic_compare_exchange_n(&q->enq, &pos, pos+i, true,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+  }
+
+  for(n = 0; n < i; n++) {
+    memcpy(_circa_mpmc_data(q, pos+n), src + q->el*n, q->el);
+    __atomic_store_n(_circa_mpmc_seq(q, pos+n), pos+n+1, __ATOMIC_RELEASE);
+  }
+  return i;
+}
+
+static inline size_t _circa_mpmc_trypop_n(CircMPMC *q, void *ptr, size_t n)
+{
+  char *dst = (char*)ptr;
+  size_t pos = __atomic_load_n(&q->deq, __ATOMIC_RELAXED), i;
+  intptr_t dif;
+
+  if(!n) return 0;
+  while(1) {
+    dif = (intptr_t)__atomic_load_n(_circa_mpmc_seq(q, pos), __ATOMIC_ACQUIRE)
+          - (intptr_t)(pos+1);
+    if(dif < 0) return 0; // empty
+    if(dif > 0) { pos = __atomic_load_n(&q->deq, __ATOMIC_RELAXED); continue; }
+    for(i = 1; i < n && __atomic_load_n(_circa_mpmc_seq(q, pos+i),
+                                        __ATOMIC_ACQUIRE) == pos+i+1; i++) {}
+    if(__atomic_compare_exchange_n(&q->deq, &pos, pos+i, true,
+                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) break;
+  }
+
+  for(n = 0; n < i; n++) {
+    memcpy(dst + q->el*n, _circa_mpmc_data(q, pos+n), q->el);
+    __atomic_store_n(_circa_mpmc_seq(q, pos+n), pos+n+q->size, __ATOMIC_RELEASE);
+  }
+  return i;
+}
+
+// Wake threads blocked on w, if there are any
+static inline void _circa_mpmc_notify(CircMPMC *q, CircMPMCWait *w)
+{
+  if(!q->futex) return;
+  // order our slot update before reading nwaiters (pairs with _wait)
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if(__atomic_load_n(&w->nwaiters, __ATOMIC_RELAXED)) {
+    __atomic_fetch_add(&w->word, 1, __ATOMIC_SEQ_CST);
+    #ifdef __linux__
+      syscall(SYS_futex, &w->word, FUTEX_WAKE_PRIVATE, INT32_MAX, NULL, NULL, 0);
+    #endif
+  }
+}
+
+// Add up to n elements, returns number added (zero if full)
+static inline size_t circa_mpmc_trypush_n(CircMPMC *q, const void *ptr, size_t n)
+{
+  size_t m = _circa_mpmc_trypush_n(q, ptr, n);
+  if(m) _circa_mpmc_notify(q, &q->notempty);
+  return m;
+}
+
+// Remove up to n elements, returns number removed (zero if empty)
+static inline size_t circa_mpmc_trypop_n(CircMPMC *q, void *ptr, size_t n)
+{
+  size_t m = _circa_mpmc_trypop_n(q, ptr, n);
+  if(m) _circa_mpmc_notify(q, &q->notfull);
+  return m;
+}
+
+static inline bool circa_mpmc_trypush(CircMPMC *q, const void *ptr)
+{
+  return circa_mpmc_trypush_n(q, ptr, 1);
+}
+
+static inline bool circa_mpmc_trypop(CircMPMC *q, void *ptr)
+{
+  return circa_mpmc_trypop_n(q, ptr, 1);
+}
+
+//
+// Blocking
+//
+
+// Call trypush_n or trypop_n until it moves at least one element
+static inline size_t _circa_mpmc_wait(CircMPMC *q, CircMPMCWait *w, void *ptr,
+                                      size_t n, bool push)
+{
+  size_t m, spins;
+  uint32_t word;
+
+  #define _mpmc_try() (push ? _circa_mpmc_trypush_n(q, ptr, n) \
+                            : _circa_mpmc_trypop_n(q, ptr, n))
+
+  for(spins = 0; spins < 100; spins++)
+    if((m = _mpmc_try())) return m;
+
+  while(1) {
+    if(!q->futex) {
+      sched_yield();
+      if((m = _mpmc_try())) return m;
+      continue;
+    }
+    word = __atomic_load_n(&w->word, __ATOMIC_SEQ_CST);
+    __atomic_fetch_add(&w->nwaiters, 1, __ATOMIC_SEQ_CST);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST); // pairs with _notify
+    m = _mpmc_try();
+    if(!m) {
+      #ifdef __linux__
+        syscall(SYS_futex, &w->word, FUTEX_WAIT_PRIVATE, word, NULL, NULL, 0);
+      #else
+        sched_yield();
+      #endif
+    }
+    __atomic_fetch_sub(&w->nwaiters, 1, __ATOMIC_SEQ_CST);
+    if(m || (m = _mpmc_try())) return m;
+  }
+
+  #undef _mpmc_try
+}
+
+// Add all n elements, blocking while full
+static inline void circa_mpmc_push_n(CircMPMC *q, const void *ptr, size_t n)
+{
+  const char *src = (const char*)ptr;
+  size_t m;
+  for(; n > 0; n -= m, src += q->el*m) {
+    m = _circa_mpmc_wait(q, &q->notfull, (void*)src, n, true);
+    _circa_mpmc_notify(q, &q->notempty);
+  }
+}
+
+// Remove between 1 and n elements, blocking while empty
+// Returns number removed
+static inline size_t circa_mpmc_pop_n(CircMPMC *q, void *ptr, size_t n)
+{
+  if(!n) return 0;
+  size_t m = _circa_mpmc_wait(q, &q->notempty, ptr, n, false);
+  _circa_mpmc_notify(q, &q->notfull);
+  return m;
+}
+
+// Add to end, blocking while full
+static inline void circa_mpmc_push(CircMPMC *q, const void *ptr)
+{
+  circa_mpmc_push_n(q, ptr, 1);
+}
+
+// Remove from start, blocking while empty
+static inline void circa_mpmc_pop(CircMPMC *q, void *ptr)
+{
+  circa_mpmc_pop_n(q, ptr, 1);
+}
+
+#endif /* CIRC_MPMC_H_ */
@@ -0,0 +1,187 @@
+#ifndef CIRC_SPSC_H_
+#define CIRC_SPSC_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "carrays.h"
+
+//
+// Lock-free single-producer/single-consumer circular array
+//
+// Fixed capacity. One thread may push and one other thread may pop without
+// locks. head and tail count up forever and are masked on use. Each side
+// keeps a cached copy of the other side's index, so it only reads the
+// shared cache line when the queue looks full (or empty).
+//
+
+typedef struct
+{
+  // written by producer
+  size_t tail __attribute__((aligned(64)));
+  size_t head_cache; // producer's last view of head
+
+  // written by consumer
+  size_t head __attribute__((aligned(64)));
+  size_t tail_cache; // consumer's last view of tail
+
+  // read-only after alloc
+  size_t el __attribute__((aligned(64))); // element size in bytes
+  size_t size, mask; // mask=size-1
+  char *b;
+} CircSPSC;
+
+static inline void circa_spsc_alloc(CircSPSC *q, size_t el, size_t size) __attribute__((unused));
+static inline void circa_spsc_dealloc(CircSPSC *q) __attribute__((unused));
+static inline void* circa_spsc_reserve(CircSPSC *q, size_t *n) __attribute__((unused));
+static inline void circa_spsc_commit(CircSPSC *q, size_t n) __attribute__((unused));
+static inline void* circa_spsc_peek(CircSPSC *q, size_t *n) __attribute__((unused));
+static inline void circa_spsc_release(CircSPSC *q, size_t n) __attribute__((unused));
+static inline bool circa_spsc_push(CircSPSC *q, const void *ptr) __attribute__((unused));
+static inline bool circa_spsc_pop(CircSPSC *q, void *ptr) __attribute__((unused));
+static inline size_t circa_spsc_push_n(CircSPSC *q, const void *ptr, size_t n) __attribute__((unused));
+static inline size_t circa_spsc_pop_n(CircSPSC *q, void *ptr, size_t n) __attribute__((unused));
+
+static inline void circa_spsc_alloc(CircSPSC *q, size_t el, size_t size)
+{
+  size = gca_roundup64(size < 2 ? 2 : size);
+  memset(q, 0, sizeof(CircSPSC));
+  q->el = el;
+  q->size = size;
+  q->mask = size-1;
+  q->b = malloc(size * el);
+}
+
+static inline void circa_spsc_dealloc(CircSPSC *q)
+{
+  free(q->b);
+}
+
+//
+// Producer
+//
+
+// Number of elements that can be pushed without blocking
+static inline size_t _circa_spsc_space(CircSPSC *q)
+{
+  size_t space = q->size - (q->tail - q->head_cache);
+  if(!space) {
+    q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    space = q->size - (q->tail - q->head_cache);
+  }
+  return space;
+}
+
+// Reserve up to *n contiguous free slots for writing
+// Sets *n to the number reserved (may be zero if full)
+// Returns pointer to the first slot
+static inline void* circa_spsc_reserve(CircSPSC *q, size_t *n)
+{
+  size_t space = q->size - (q->tail - q->head_cache), pos = q->tail & q->mask;
+  if(space < *n) {
+    q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    space = q->size - (q->tail - q->head_cache);
+  }
+  if(space > q->size - pos) space = q->size - pos;
+  if(*n > space) *n = space;
+  return q->b + q->el*pos;
+}
+
+// Publish n reserved slots to the consumer, with a single atomic store
+static inline void circa_spsc_commit(CircSPSC *q, size_t n)
+{
+  __atomic_store_n(&q->tail, q->tail + n, __ATOMIC_RELEASE);
+}
+
+// Add to end, returns false if full
+static inline bool circa_spsc_push(CircSPSC *q, const void *ptr)
+{
+  if(!_circa_spsc_space(q)) return false;
+  memcpy(q->b + q->el*(q->tail & q->mask), ptr, q->el);
+  __atomic_store_n(&q->tail, q->tail + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Add up to n elements to the end, returns number added
+static inline size_t circa_spsc_push_n(CircSPSC *q, const void *ptr, size_t n)
+{
+  const char *src = (const char*)ptr;
+  size_t space = q->size - (q->tail - q->head_cache), pos, n1;
+  if(space < n) {
+    q->head_cache = __atomic_load_n(&q->head, __ATOMIC_ACQUIRE);
+    space = q->size - (q->tail - q->head_cache);
+  }
+  if(n > space) n = space;
+  pos = q->tail & q->mask;
+  n1 = q->size - pos < n ? q->size - pos : n;
+  memcpy(q->b + q->el*pos, src, q->el*n1);
+  memcpy(q->b, src + q->el*n1, q->el*(n-n1));
+  __atomic_store_n(&q->tail, q->tail + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+//
+// Consumer
+//
+
+// Number of elements that can be popped without blocking
+static inline size_t _circa_spsc_avail(CircSPSC *q)
+{
+  size_t avail = q->tail_cache - q->head;
+  if(!avail) {
+    q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    avail = q->tail_cache - q->head;
+  }
+  return avail;
+}
+
+// Get up to *n contiguous elements for reading
+// Sets *n to the number available (may be zero if empty)
+// Returns pointer to the first element
+static inline void* circa_spsc_peek(CircSPSC *q, size_t *n)
+{
+  size_t avail = q->tail_cache - q->head, pos = q->head & q->mask;
+  if(avail < *n) {
+    q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    avail = q->tail_cache - q->head;
+  }
+  if(avail > q->size - pos) avail = q->size - pos;
+  if(*n > avail) *n = avail;
+  return q->b + q->el*pos;
+}
+
+// Hand n read elements back to the producer, with a single atomic store
+static inline void circa_spsc_release(CircSPSC *q, size_t n)
+{
+  __atomic_store_n(&q->head, q->head + n, __ATOMIC_RELEASE);
+}
+
+// Remove from start, returns false if empty
+static inline bool circa_spsc_pop(CircSPSC *q, void *ptr)
+{
+  if(!_circa_spsc_avail(q)) return false;
+  memcpy(ptr, q->b + q->el*(q->head & q->mask), q->el);
+  __atomic_store_n(&q->head, q->head + 1, __ATOMIC_RELEASE);
+  return true;
+}
+
+// Remove up to n elements from the start, returns number removed
+static inline size_t circa_spsc_pop_n(CircSPSC *q, void *ptr, size_t n)
+{
+  char *dst = (char*)ptr;
+  size_t avail = q->tail_cache - q->head, pos, n1;
+  if(avail < n) {
+    q->tail_cache = __atomic_load_n(&q->tail, __ATOMIC_ACQUIRE);
+    avail = q->tail_cache - q->head;
+  }
+  if(n > avail) n = avail;
+  pos = q->head & q->mask;
+  n1 = q->size - pos < n ? q->size - pos : n;
+  memcpy(dst, q->b + q->el*pos, q->el*n1);
+  memcpy(dst + q->el*n1, q->b, q->el*(n-n1));
+  __atomic_store_n(&q->head, q->head + n, __ATOMIC_RELEASE);
+  return n;
+}
+
+#endif /* CIRC_SPSC_H_ */
@@ -0,0 +1,309 @@
+#ifndef CIRC_WINDOW_H_
+#define CIRC_WINDOW_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "circ_array.h"
+#include "pqueue.h"
+
+//
+// Sliding window aggregates
+//
+// Each aggregate tracks a window that grows at the end and shrinks from the
+// start, like a CircBuf used with circa_unshift() / circa_pop(). Call
+// unshift with each value added to the window and pop each time the oldest
+// value is removed. Values are copied in, so the aggregate does not need the
+// window itself.
+//
+//   CircMinMax  - min and max in O(1) amortised (monotonic deques)
+//   CircSum     - sum and mean in O(1) (compensated summation)
+//   CircQuant   - any quantile in O(log n) (two indexed heaps)
+//
+// compar follows the same convention as everywhere else in carrays.
+// Structs must not be copied or moved after alloc.
+//
+
+//
+// Min / max
+//
+// Two deques of (sequence number, element). The max deque holds elements
+// that are larger than everything after them, in decreasing order. An element
+// that is added removes any smaller ones from the end, since they can never
+// be the max while it is in the window. The min deque is the mirror image.
+//
+
+typedef struct
+{
+  const size_t es; // element size in bytes
+  size_t n; // number of elements in the window
+  size_t nadded; // sequence number of the next element added
+  CircBuf mins, maxs; // entries are [size_t seq][element]
+  int (*compar)(const void *_a, const void *_b, void *_arg);
+  void *arg;
+} CircMinMax;
+
+static inline void circa_minmax_alloc(CircMinMax *w, size_t es,
+                                      int (*compar)(const void *_a,
+                                                    const void *_b,
+                                                    void *_arg),
+                                      void *arg) __attribute__((unused));
+static inline void circa_minmax_dealloc(CircMinMax *w) __attribute__((unused));
+static inline void circa_minmax_unshift(CircMinMax *w, const void *ptr) __attribute__((unused));
+static inline void circa_minmax_pop(CircMinMax *w) __attribute__((unused));
+
+// Entry size: sequence number then element, padded to keep seq aligned
+#define _circa_entry_size(es) \
+  ((sizeof(size_t) + (es) + sizeof(size_t)-1) & ~(sizeof(size_t)-1))
+#define _circa_entry_seq(ptr) (*(size_t*)(ptr))
+#define _circa_entry_elem(ptr) ((void*)((char*)(ptr) + sizeof(size_t)))
+
+// Smallest / largest element in the window. Undefined if w->n == 0
+#define circa_minmax_min(w) _circa_entry_elem(circa_get(&(w)->mins, 0))
+#define circa_minmax_max(w) _circa_entry_elem(circa_get(&(w)->maxs, 0))
+
+static inline void circa_minmax_alloc(CircMinMax *w, size_t es,
+                                      int (*compar)(const void *_a,
+                                                    const void *_b,
+                                                    void *_arg),
+                                      void *arg)
+{
+  CircMinMax tmp = {.es = es, .n = 0, .nadded = 0,
+                    .compar = compar, .arg = arg};
+  memcpy(w, &tmp, sizeof(CircMinMax));
+  circa_alloc(&w->mins, _circa_entry_size(es), 16);
+  circa_alloc(&w->maxs, _circa_entry_size(es), 16);
+  w->mins.nozero = w->maxs.nozero = true;
+}
+
+static inline void circa_minmax_dealloc(CircMinMax *w)
+{
+  circa_dealloc(&w->mins);
+  circa_dealloc(&w->maxs);
+}
+
+// Drop entries from the end of deque d that can no longer be the max (or min
+// if ismax is false) then append ptr
+static inline void _circa_minmax_add(CircMinMax *w, CircBuf *d, bool ismax,
+                                     const void *ptr)
+{
+  void *e;
+  int c;
+  while(d->n) {
+    c = w->compar(_circa_entry_elem(circa_get(d, d->n-1)), ptr, w->arg);
+    if(ismax ? c > 0 : c < 0) break;
+    circa_shift(d);
+  }
+  e = circa_unshift(d);
+  _circa_entry_seq(e) = w->nadded;
+  memcpy(_circa_entry_elem(e), ptr, w->es);
+}
+
+// Add to end of window
+static inline void circa_minmax_unshift(CircMinMax *w, const void *ptr)
+{
+  _circa_minmax_add(w, &w->maxs, true, ptr);
+  _circa_minmax_add(w, &w->mins, false, ptr);
+  w->nadded++;
+  w->n++;
+}
+
+// Remove from start of window
+static inline void circa_minmax_pop(CircMinMax *w)
+{
+  assert(w->n > 0);
+  size_t seq = w->nadded - w->n; // oldest element
+  if(_circa_entry_seq(circa_get(&w->maxs, 0)) == seq) circa_pop(&w->maxs);
+  if(_circa_entry_seq(circa_get(&w->mins, 0)) == seq) circa_pop(&w->mins);
+  w->n--;
+}
+
+//
+// Sum / mean
+//
+// Keeps its own copy of the window so that pop knows what to subtract.
+// Uses Neumaier's compensated summation, so rounding errors do not build up
+// as values are added and removed over a long run.
+//
+
+typedef struct
+{
+  CircBuf vals; // window of doubles
+  double sum, c; // running sum, compensation for lost low-order bits
+} CircSum;
+
+static inline void circa_sum_alloc(CircSum *w, size_t size) __attribute__((unused));
+static inline void circa_sum_dealloc(CircSum *w) __attribute__((unused));
+static inline void circa_sum_unshift(CircSum *w, double x) __attribute__((unused));
+static inline double circa_sum_pop(CircSum *w) __attribute__((unused));
+
+#define circa_sum_n(w) ((w)->vals.n)
+#define circa_sum_total(w) ((w)->sum + (w)->c)
+// NaN if the window is empty
+#define circa_sum_mean(w) (circa_sum_total(w) / (double)(w)->vals.n)
+
+// size is the expected window size
+static inline void circa_sum_alloc(CircSum *w, size_t size)
+{
+  circa_alloc(&w->vals, sizeof(double), size ? size : 1);
+  w->vals.nozero = true;
+  w->sum = w->c = 0;
+}
+
+static inline void circa_sum_dealloc(CircSum *w)
+{
+  circa_dealloc(&w->vals);
+}
+
+static inline void _circa_sum_add(CircSum *w, double x)
+{
+  double t = w->sum + x;
+  double abss = w->sum < 0 ? -w->sum : w->sum, absx = x < 0 ? -x : x;
+  if(abss >= absx) w->c += (w->sum - t) + x;
+  else w->c += (x - t) + w->sum;
+  w->sum = t;
+}
+
+// Add to end of window
+static inline void circa_sum_unshift(CircSum *w, double x)
+{
+  *(double*)circa_unshift(&w->vals) = x;
+  _circa_sum_add(w, x);
+}
+
+// Remove from start of window, returns the value removed
+static inline double circa_sum_pop(CircSum *w)
+{
+  double x = *(double*)circa_pop(&w->vals);
+  if(w->vals.n) _circa_sum_add(w, -x);
+  else w->sum = w->c = 0; // drop any error left over
+  return x;
+}
+
+//
+// Quantiles
+//
+// The window is split between two indexed priority queues (see pqueue.h):
+// `lo` is a max-heap of the k smallest elements and `hi` a min-heap of the
+// rest, where k = floor(q*(n-1)) + 1. The q-quantile is the top of `lo`. A
+// FIFO of heap handles, in window order, lets pop remove the oldest element
+// from whichever heap holds it. Each call is O(log n).
+//
+// q = 0.5 gives the median (the lower median when n is even).
+//
+
+typedef struct
+{
+  size_t heap, handle;
+} CircQuantLoc;
+
+typedef struct
+{
+  const size_t es; // element size in bytes
+  const double q; // quantile in [0,1]
+  size_t nadded; // sequence number of the next element added
+  GcaPQ lo, hi; // heap elements are [size_t seq][element]
+  CircBuf locs; // CircQuantLoc for each element, oldest first
+  char *tmp; // one heap element
+  int (*compar)(const void *_a, const void *_b, void *_arg);
+  void *arg;
+} CircQuant;
+
+static inline void circa_quant_alloc(CircQuant *w, size_t es, double q,
+                                     int (*compar)(const void *_a,
+                                                   const void *_b,
+                                                   void *_arg),
+                                     void *arg) __attribute__((unused));
+static inline void circa_quant_dealloc(CircQuant *w) __attribute__((unused));
+static inline void circa_quant_unshift(CircQuant *w, const void *ptr) __attribute__((unused));
+static inline void circa_quant_pop(CircQuant *w) __attribute__((unused));
+
+#define circa_quant_n(w) ((w)->locs.n)
+// The q-quantile of the window. Undefined if the window is empty
+#define circa_quant_get(w) _circa_entry_elem(gca_pq_peek(&(w)->lo))
+
+static inline int _circa_quant_cmp_lo(const void *a, const void *b, void *arg)
+{
+  CircQuant *w = (CircQuant*)arg;
+  return w->compar(_circa_entry_elem(a), _circa_entry_elem(b), w->arg);
+}
+
+static inline int _circa_quant_cmp_hi(const void *a, const void *b, void *arg)
+{
+  CircQuant *w = (CircQuant*)arg;
+  return w->compar(_circa_entry_elem(b), _circa_entry_elem(a), w->arg);
+}
+
+static inline void circa_quant_alloc(CircQuant *w, size_t es, double q,
+                                     int (*compar)(const void *_a,
+                                                   const void *_b,
+                                                   void *_arg),
+                                     void *arg)
+{
+  assert(q >= 0 && q <= 1);
+  CircQuant tmp = {.es = es, .q = q, .nadded = 0,
+                   .tmp = malloc(_circa_entry_size(es)),
+                   .compar = compar, .arg = arg};
+  memcpy(w, &tmp, sizeof(CircQuant));
+  gca_pq_alloc(&w->lo, _circa_entry_size(es), 16, _circa_quant_cmp_lo, w);
+  gca_pq_alloc(&w->hi, _circa_entry_size(es), 16, _circa_quant_cmp_hi, w);
+  circa_alloc(&w->locs, sizeof(CircQuantLoc), 16);
+  w->locs.nozero = true;
+}
+
+static inline void circa_quant_dealloc(CircQuant *w)
+{
+  gca_pq_dealloc(&w->lo);
+  gca_pq_dealloc(&w->hi);
+  circa_dealloc(&w->locs);
+  free(w->tmp);
+}
+
+// Add heap element e to heap `heap` and record where it went
+static inline void _circa_quant_insert(CircQuant *w, size_t heap, const void *e)
+{
+  size_t h = gca_pq_push(heap ? &w->hi : &w->lo, e);
+  CircQuantLoc *loc = circa_get(&w->locs, _circa_entry_seq(e) - (w->nadded - w->locs.n));
+  loc->heap = heap;
+  loc->handle = h;
+}
+
+// Move the top of one heap to the other
+static inline void _circa_quant_move(CircQuant *w, size_t from)
+{
+  GcaPQ *pq = from ? &w->hi : &w->lo;
+  memcpy(w->tmp, gca_pq_pop(pq), pq->es);
+  _circa_quant_insert(w, !from, w->tmp);
+}
+
+// Move elements between heaps until lo holds the k smallest
+static inline void _circa_quant_balance(CircQuant *w)
+{
+  size_t n = w->locs.n, k = n ? (size_t)(w->q * (n-1)) + 1 : 0;
+  while(w->lo.n > k) _circa_quant_move(w, 0);
+  while(w->lo.n < k) _circa_quant_move(w, 1);
+}
+
+// Add to end of window
+static inline void circa_quant_unshift(CircQuant *w, const void *ptr)
+{
+  circa_unshift(&w->locs);
+  _circa_entry_seq(w->tmp) = w->nadded++;
+  memcpy(_circa_entry_elem(w->tmp), ptr, w->es);
+  // everything in lo is <= everything in hi
+  size_t heap = !(w->lo.n && w->compar(ptr, circa_quant_get(w), w->arg) <= 0);
+  _circa_quant_insert(w, heap, w->tmp);
+  _circa_quant_balance(w);
+}
+
+// Remove from start of window
+static inline void circa_quant_pop(CircQuant *w)
+{
+  assert(w->locs.n > 0);
+  CircQuantLoc *loc = circa_pop(&w->locs);
+  gca_pq_remove(loc->heap ? &w->hi : &w->lo, loc->handle);
+  _circa_quant_balance(w);
+}
+
+#endif /* CIRC_WINDOW_H_ */
@@ -0,0 +1,185 @@
+#ifndef MULTIQUEUE_H_
+#define MULTIQUEUE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <pthread.h>
+#include <unistd.h> // sysconf()
+
+#include "carrays.h"
+
+//
+// Concurrent priority queue (MultiQueue)
+//
+// Elements are spread over many max-heaps, each with its own lock. Push adds
+// to a random heap. In relaxed mode pop takes the larger top of two random
+// heaps, so it returns one of the largest elements, but not always the
+// largest. In strict mode pop locks every heap and takes the largest top.
+// Use a few heaps per thread (e.g. 2-4 x nthreads) in relaxed mode.
+//
+// Heaps are built with gca_heap_pushup() / gca_heap_pop().
+// Compile with -pthread.
+//
+
+typedef struct
+{
+  pthread_mutex_t lock;
+  size_t n, size;
+  char *b;
+} __attribute__((aligned(64))) GcaMQHeap;
+
+typedef struct
+{
+  const size_t es; // element size in bytes
+  const size_t nheaps;
+  const bool strict; // strict ordering, pop always returns the max
+  GcaMQHeap *heaps;
+  int (*compar)(const void *_a, const void *_b, void *_arg);
+  void *arg;
+} GcaMQueue;
+
+static inline void gca_mq_alloc(GcaMQueue *mq, size_t es, size_t nheaps,
+                                bool strict,
+                                int (*compar)(const void *_a, const void *_b,
+                                              void *_arg),
+                                void *arg) __attribute__((unused));
+static inline void gca_mq_dealloc(GcaMQueue *mq) __attribute__((unused));
+static inline void gca_mq_push(GcaMQueue *mq, const void *ptr) __attribute__((unused));
+static inline bool gca_mq_pop(GcaMQueue *mq, void *ptr) __attribute__((unused));
+static inline size_t gca_mq_size(GcaMQueue *mq) __attribute__((unused));
+
+// nheaps == 0 uses two heaps per online processor
+static inline void gca_mq_alloc(GcaMQueue *mq, size_t es, size_t nheaps,
+                                bool strict,
+                                int (*compar)(const void *_a, const void *_b,
+                                              void *_arg),
+                                void *arg)
+{
+  size_t i;
+  if(!nheaps) {
+    long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+    nheaps = 2 * (nproc > 0 ? nproc : 1);
+  }
+  GcaMQueue tmp = {.es = es, .nheaps = nheaps, .strict = strict,
+                   .heaps = NULL, .compar = compar, .arg = arg};
+  if(posix_memalign((void**)&tmp.heaps, 64, nheaps * sizeof(GcaMQHeap)) != 0)
+    tmp.heaps = NULL;
+  assert(tmp.heaps != NULL);
+  for(i = 0; i < nheaps; i++) {
+    pthread_mutex_init(&tmp.heaps[i].lock, NULL);
+    tmp.heaps[i].n = 0;
+    tmp.heaps[i].size = 0;
+    tmp.heaps[i].b = NULL;
+  }
+  memcpy(mq, &tmp, sizeof(GcaMQueue));
+}
+
+static inline void gca_mq_dealloc(GcaMQueue *mq)
+{
+  size_t i;
+  for(i = 0; i < mq->nheaps; i++) {
+    pthread_mutex_destroy(&mq->heaps[i].lock);
+    free(mq->heaps[i].b);
+  }
+  free(mq->heaps);
+}
+
+// xorshift64*, one state per thread
+static inline size_t _gca_mq_rand(size_t n)
+{
+  static __thread uint64_t x = 0;
+  if(!x) x = (uint64_t)(size_t)&x ^ 0x9E3779B97F4A7C15ULL;
+  x ^= x >> 12; x ^= x << 25; x ^= x >> 27;
+  return ((x * 0x2545F4914F6CDD1DULL) >> 32) % n;
+}
+
+// Lock a random heap, spinning over random heaps until one is free
+static inline GcaMQHeap* _gca_mq_lock_any(GcaMQueue *mq)
+{
+  GcaMQHeap *h;
+  do { h = &mq->heaps[_gca_mq_rand(mq->nheaps)]; }
+  while(pthread_mutex_trylock(&h->lock) != 0);
+  return h;
+}
+
+// Add an element
+static inline void gca_mq_push(GcaMQueue *mq, const void *ptr)
+{
+  GcaMQHeap *h = _gca_mq_lock_any(mq);
+  h->b = gca_capacity(h->b, &h->size, mq->es, h->n+1);
+  assert(h->b != NULL);
+  memcpy(h->b + mq->es*h->n, ptr, mq->es);
+  h->n++;
+  gca_heap_pushup(h->b, h->n, mq->es, mq->compar, mq->arg);
+  pthread_mutex_unlock(&h->lock);
+}
+
+// Pop the top of a locked heap into ptr, if it is not empty
+static inline bool _gca_mq_pop_heap(GcaMQueue *mq, GcaMQHeap *h, void *ptr)
+{
+  if(!h->n) return false;
+  gca_heap_pop(h->b, h->n, mq->es, mq->compar, mq->arg);
+  h->n--;
+  memcpy(ptr, h->b + mq->es*h->n, mq->es);
+  return true;
+}
+
+// Lock every heap and pop the largest top
+static inline bool _gca_mq_pop_strict(GcaMQueue *mq, void *ptr)
+{
+  size_t i;
+  GcaMQHeap *h, *best = NULL;
+  for(i = 0; i < mq->nheaps; i++) {
+    h = &mq->heaps[i];
+    pthread_mutex_lock(&h->lock);
+    if(h->n && (!best || mq->compar(best->b, h->b, mq->arg) < 0)) best = h;
+  }
+  bool popped = best && _gca_mq_pop_heap(mq, best, ptr);
+  for(i = 0; i < mq->nheaps; i++) pthread_mutex_unlock(&mq->heaps[i].lock);
+  return popped;
+}
+
+// Remove an element, copying it into ptr
+// Returns false if the queue was empty
+static inline bool gca_mq_pop(GcaMQueue *mq, void *ptr)
+{
+  size_t i, tries;
+  GcaMQHeap *a, *b;
+  bool popped;
+
+  if(mq->strict || mq->nheaps == 1) return _gca_mq_pop_strict(mq, ptr);
+
+  // two-choice: take the larger top of two random heaps
+  for(tries = 0; tries < 4; tries++) {
+    a = _gca_mq_lock_any(mq);
+    b = &mq->heaps[_gca_mq_rand(mq->nheaps)];
+    if(b != a && pthread_mutex_trylock(&b->lock) == 0) {
+      if(b->n && (!a->n || mq->compar(a->b, b->b, mq->arg) < 0)) SWAP(a, b);
+      pthread_mutex_unlock(&b->lock);
+    }
+    popped = _gca_mq_pop_heap(mq, a, ptr);
+    pthread_mutex_unlock(&a->lock);
+    if(popped) return true;
+  }
+
+  // random heaps were empty, check all of them before giving up
+  for(i = 0; i < mq->nheaps; i++) {
+    a = &mq->heaps[i];
+    pthread_mutex_lock(&a->lock);
+    popped = _gca_mq_pop_heap(mq, a, ptr);
+    pthread_mutex_unlock(&a->lock);
+    if(popped) return true;
+  }
+  return false;
+}
+
+// Number of elements, only exact if no other thread is using the queue
+static inline size_t gca_mq_size(GcaMQueue *mq)
+{
+  size_t i, n = 0;
+  for(i = 0; i < mq->nheaps; i++) n += __atomic_load_n(&mq->heaps[i].n, __ATOMIC_RELAXED);
+  return n;
+}
+
+#endif /* MULTIQUEUE_H_ */
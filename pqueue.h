@@ -0,0 +1,230 @@
+#ifndef PQUEUE_H_
+#define PQUEUE_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include "carrays.h"
+
+//
+// Indexed priority queue
+//
+// A binary max-heap (largest element by `compar` at the top) that keeps a
+// map from handle to heap position, so the element behind a handle can be
+// re-prioritised or removed in O(log n). Reverse `compar` for a min-queue.
+//
+// Elements are stored by handle and never move; the heap holds handles.
+// Handles of popped/removed elements are recycled by later pushes.
+//
+
+#define GCA_PQ_NONE SIZE_MAX
+
+typedef struct
+{
+  const size_t es; // element size in bytes
+  size_t n, size; // number of elements in the heap, capacity
+  size_t nhandles, nfree; // handles ever used, handles free for reuse
+  char *b; // elements indexed by handle
+  size_t *heap; // heap[i] is the handle at heap position i
+  size_t *pos; // pos[handle] is the heap position or GCA_PQ_NONE
+  size_t *freeh; // stack of free handles
+  int (*compar)(const void *_a, const void *_b, void *_arg);
+  void *arg;
+} GcaPQ;
+
+static inline void gca_pq_alloc(GcaPQ *pq, size_t es, size_t size,
+                                int (*compar)(const void *_a, const void *_b,
+                                              void *_arg),
+                                void *arg) __attribute__((unused));
+static inline void gca_pq_dealloc(GcaPQ *pq) __attribute__((unused));
+static inline void gca_pq_capacity(GcaPQ *pq, size_t size) __attribute__((unused));
+static inline size_t gca_pq_push(GcaPQ *pq, const void *ptr) __attribute__((unused));
+static inline void gca_pq_push_n(GcaPQ *pq, const void *ptr, size_t m,
+                                 size_t *handles) __attribute__((unused));
+static inline void* gca_pq_pop(GcaPQ *pq) __attribute__((unused));
+static inline void* gca_pq_remove(GcaPQ *pq, size_t h) __attribute__((unused));
+static inline void gca_pq_update(GcaPQ *pq, size_t h) __attribute__((unused));
+static inline void gca_pq_increase_key(GcaPQ *pq, size_t h,
+                                       const void *ptr) __attribute__((unused));
+static inline void gca_pq_decrease_key(GcaPQ *pq, size_t h,
+                                       const void *ptr) __attribute__((unused));
+
+#define gca_pq_get(pq,h) ((void*)((pq)->b + (pq)->es * (h)))
+#define gca_pq_contains(pq,h) ((h) < (pq)->nhandles && (pq)->pos[h] != GCA_PQ_NONE)
+// Handle / element at the top of the heap. Undefined if pq->n == 0
+#define gca_pq_top(pq) ((pq)->heap[0])
+#define gca_pq_peek(pq) gca_pq_get(pq, gca_pq_top(pq))
+
+static inline void gca_pq_alloc(GcaPQ *pq, size_t es, size_t size,
+                                int (*compar)(const void *_a, const void *_b,
+                                              void *_arg),
+                                void *arg)
+{
+  size = size < 8 ? 8 : gca_roundup64(size);
+  GcaPQ tmp = {.es = es, .n = 0, .size = size, .nhandles = 0, .nfree = 0,
+               .b = malloc(size * es),
+               .heap = malloc(size * sizeof(size_t)),
+               .pos = malloc(size * sizeof(size_t)),
+               .freeh = malloc(size * sizeof(size_t)),
+               .compar = compar, .arg = arg};
+  memcpy(pq, &tmp, sizeof(GcaPQ));
+}
+
+static inline void gca_pq_dealloc(GcaPQ *pq)
+{
+  free(pq->b);
+  free(pq->heap);
+  free(pq->pos);
+  free(pq->freeh);
+}
+
+static inline void gca_pq_capacity(GcaPQ *pq, size_t size)
+{
+  if(size <= pq->size) return;
+  size = gca_roundup64(size);
+  pq->b = realloc(pq->b, size * pq->es);
+  pq->heap = realloc(pq->heap, size * sizeof(size_t));
+  pq->pos = realloc(pq->pos, size * sizeof(size_t));
+  pq->freeh = realloc(pq->freeh, size * sizeof(size_t));
+  pq->size = size;
+}
+
+#define _gca_pq_cmp(pq,h1,h2) \
+  ((pq)->compar(gca_pq_get(pq,h1), gca_pq_get(pq,h2), (pq)->arg))
+
+// Handle at heap position i, to be pushed up the heap
+static inline void _gca_pq_siftup(GcaPQ *pq, size_t i)
+{
+  size_t h = pq->heap[i], pi;
+  for(; i > 0; i = pi) {
+    pi = gca_heap_parent(i);
+    if(_gca_pq_cmp(pq, pq->heap[pi], h) >= 0) break;
+    pq->heap[i] = pq->heap[pi];
+    pq->pos[pq->heap[i]] = i;
+  }
+  pq->heap[i] = h;
+  pq->pos[h] = i;
+}
+
+// Handle at heap position i, to be pushed down the heap
+static inline void _gca_pq_siftdwn(GcaPQ *pq, size_t i)
+{
+  size_t h = pq->heap[i], ci;
+  while((ci = gca_heap_child1(i)) < pq->n) {
+    // biggest child
+    if(ci+1 < pq->n && _gca_pq_cmp(pq, pq->heap[ci], pq->heap[ci+1]) < 0) ci++;
+    if(_gca_pq_cmp(pq, h, pq->heap[ci]) >= 0) break;
+    pq->heap[i] = pq->heap[ci];
+    pq->pos[pq->heap[i]] = i;
+    i = ci;
+  }
+  pq->heap[i] = h;
+  pq->pos[h] = i;
+}
+
+// Copy an element into a free handle and append it to the end of the heap
+// Returns the new handle
+static inline size_t _gca_pq_add(GcaPQ *pq, const void *ptr)
+{
+  size_t h = pq->nfree ? pq->freeh[--pq->nfree] : pq->nhandles++;
+  memcpy(gca_pq_get(pq, h), ptr, pq->es);
+  pq->heap[pq->n] = h;
+  pq->pos[h] = pq->n++;
+  return h;
+}
+
+// Add an element, returns its handle
+static inline size_t gca_pq_push(GcaPQ *pq, const void *ptr)
+{
+  gca_pq_capacity(pq, pq->n+1);
+  size_t h = _gca_pq_add(pq, ptr);
+  _gca_pq_siftup(pq, pq->n-1);
+  return h;
+}
+
+// Add m elements from array ptr, storing their handles in `handles` if not
+// NULL. Rebuilds the heap in O(n+m) when that beats m pushes of O(log n).
+static inline void gca_pq_push_n(GcaPQ *pq, const void *ptr, size_t m,
+                                 size_t *handles)
+{
+  size_t i, h, logn;
+  const char *src = (const char*)ptr;
+  gca_pq_capacity(pq, pq->n+m);
+  for(logn = 1; (pq->n+m) >> logn; logn++) {}
+
+  if(m * logn > pq->n + m) {
+    for(i = 0; i < m; i++) {
+      h = _gca_pq_add(pq, src + pq->es*i);
+      if(handles) handles[i] = h;
+    }
+    for(i = pq->n/2; i-- > 0; ) _gca_pq_siftdwn(pq, i);
+  }
+  else {
+    for(i = 0; i < m; i++) {
+      h = _gca_pq_add(pq, src + pq->es*i);
+      _gca_pq_siftup(pq, pq->n-1);
+      if(handles) handles[i] = h;
+    }
+  }
+}
+
+// Remove the element with handle h
+// Returns a pointer to the element removed, valid until the next push
+static inline void* gca_pq_remove(GcaPQ *pq, size_t h)
+{
+  assert(gca_pq_contains(pq, h));
+  size_t i = pq->pos[h], last = pq->heap[--pq->n];
+  pq->pos[h] = GCA_PQ_NONE;
+  pq->freeh[pq->nfree++] = h;
+  if(i < pq->n) {
+    pq->heap[i] = last;
+    pq->pos[last] = i;
+    if(i > 0 && _gca_pq_cmp(pq, pq->heap[gca_heap_parent(i)], last) < 0)
+      _gca_pq_siftup(pq, i);
+    else
+      _gca_pq_siftdwn(pq, i);
+  }
+  return gca_pq_get(pq, h);
+}
+
+// Remove the element at the top of the heap
+// Returns a pointer to the element removed, valid until the next push
+static inline void* gca_pq_pop(GcaPQ *pq)
+{
+  assert(pq->n > 0);
+  return gca_pq_remove(pq, pq->heap[0]);
+}
+
+// Restore the heap after the element with handle h was modified in place
+static inline void gca_pq_update(GcaPQ *pq, size_t h)
+{
+  assert(gca_pq_contains(pq, h));
+  size_t i = pq->pos[h];
+  if(i > 0 && _gca_pq_cmp(pq, pq->heap[gca_heap_parent(i)], h) < 0)
+    _gca_pq_siftup(pq, i);
+  else
+    _gca_pq_siftdwn(pq, i);
+}
+
+// Replace element h with one that compares >= to it (moves towards the top)
+static inline void gca_pq_increase_key(GcaPQ *pq, size_t h, const void *ptr)
+{
+  assert(gca_pq_contains(pq, h));
+  assert(pq->compar(ptr, gca_pq_get(pq, h), pq->arg) >= 0);
+  memcpy(gca_pq_get(pq, h), ptr, pq->es);
+  _gca_pq_siftup(pq, pq->pos[h]);
+}
+
+// Replace element h with one that compares <= to it (moves away from the top)
+static inline void gca_pq_decrease_key(GcaPQ *pq, size_t h, const void *ptr)
+{
+  assert(gca_pq_contains(pq, h));
+  assert(pq->compar(ptr, gca_pq_get(pq, h), pq->arg) <= 0);
+  memcpy(gca_pq_get(pq, h), ptr, pq->es);
+  _gca_pq_siftdwn(pq, pq->pos[h]);
+}
+
+#undef _gca_pq_cmp
+
+#endif /* PQUEUE_H_ */
@@ -0,0 +1,352 @@
+#ifndef QUANTILES_H_
+#define QUANTILES_H_
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <assert.h>
+
+#include "carrays.h"
+
+//
+// Streaming quantiles
+//
+// gca_median() and gca_qselect() need all the data in memory and reorder it.
+// These take values one (or a block) at a time:
+//
+//   GcaRunMedian - exact running median of any element type, using two heaps.
+//                  Memory grows with the number of values.
+//   GcaKLL       - approximate quantiles of doubles in bounded memory, using a
+//                  KLL sketch. Sketches can be merged, e.g. one per thread.
+//
+// Structs must not be copied or moved after alloc.
+//
+
+//
+// Running median
+//
+// `lo` is a max-heap of the smaller half of the values and `hi` a min-heap of
+// the larger half, with lo holding the extra value when n is odd. Adding a
+// value is O(log n); the median is at the top of the heaps.
+//
+
+typedef struct
+{
+  const size_t es; // element size in bytes
+  size_t nlo, nhi, sizelo, sizehi; // heap lengths and capacities
+  char *lo, *hi;
+  int (*compar)(const void *_a, const void *_b, void *_arg);
+  void *arg;
+} GcaRunMedian;
+
+static inline void gca_runmed_alloc(GcaRunMedian *m, size_t es,
+                                    int (*compar)(const void *_a,
+                                                  const void *_b,
+                                                  void *_arg),
+                                    void *arg) __attribute__((unused));
+static inline void gca_runmed_dealloc(GcaRunMedian *m) __attribute__((unused));
+static inline void gca_runmed_add(GcaRunMedian *m, const void *ptr) __attribute__((unused));
+static inline void gca_runmed_add_n(GcaRunMedian *m, const void *ptr, size_t n) __attribute__((unused));
+static inline void gca_runmed_merge(GcaRunMedian *dst, const GcaRunMedian *src) __attribute__((unused));
+
+#define gca_runmed_n(m) ((m)->nlo + (m)->nhi)
+// Lower and upper median. The same element if n is odd, undefined if n == 0.
+// Average them for the usual median of an even number of values.
+#define gca_runmed_lo(m) ((void*)(m)->lo)
+#define gca_runmed_hi(m) ((void*)((m)->nlo > (m)->nhi ? (m)->lo : (m)->hi))
+
+static inline int _gca_runmed_cmp_lo(const void *a, const void *b, void *arg)
+{
+  GcaRunMedian *m = (GcaRunMedian*)arg;
+  return m->compar(a, b, m->arg);
+}
+
+static inline int _gca_runmed_cmp_hi(const void *a, const void *b, void *arg)
+{
+  GcaRunMedian *m = (GcaRunMedian*)arg;
+  return m->compar(b, a, m->arg);
+}
+
+static inline void gca_runmed_alloc(GcaRunMedian *m, size_t es,
+                                    int (*compar)(const void *_a,
+                                                  const void *_b,
+                                                  void *_arg),
+                                    void *arg)
+{
+  GcaRunMedian tmp = {.es = es, .nlo = 0, .nhi = 0, .sizelo = 16, .sizehi = 16,
+                      .lo = malloc(16 * es), .hi = malloc(16 * es),
+                      .compar = compar, .arg = arg};
+  memcpy(m, &tmp, sizeof(GcaRunMedian));
+}
+
+static inline void gca_runmed_dealloc(GcaRunMedian *m)
+{
+  free(m->lo);
+  free(m->hi);
+  m->lo = m->hi = NULL;
+  m->nlo = m->nhi = 0;
+}
+
+// Copy ptr onto the end of heap `hi` or `lo` and push it up
+static inline void _gca_runmed_push(GcaRunMedian *m, bool hi, const void *ptr)
+{
+  if(hi) {
+    m->hi = gca_capacity(m->hi, &m->sizehi, m->es, m->nhi+1);
+    memcpy(m->hi + m->es * m->nhi++, ptr, m->es);
+    gca_heap_pushup(m->hi, m->nhi, m->es, _gca_runmed_cmp_hi, m);
+  } else {
+    m->lo = gca_capacity(m->lo, &m->sizelo, m->es, m->nlo+1);
+    memcpy(m->lo + m->es * m->nlo++, ptr, m->es);
+    gca_heap_pushup(m->lo, m->nlo, m->es, _gca_runmed_cmp_lo, m);
+  }
+}
+
+// Move the top of one heap to the other
+static inline void _gca_runmed_move(GcaRunMedian *m, bool fromhi)
+{
+  char tmp[m->es];
+  if(fromhi) {
+    gca_heap_pop(m->hi, m->nhi, m->es, _gca_runmed_cmp_hi, m);
+    memcpy(tmp, m->hi + m->es * --m->nhi, m->es);
+  } else {
+    gca_heap_pop(m->lo, m->nlo, m->es, _gca_runmed_cmp_lo, m);
+    memcpy(tmp, m->lo + m->es * --m->nlo, m->es);
+  }
+  _gca_runmed_push(m, !fromhi, tmp);
+}
+
+static inline void gca_runmed_add(GcaRunMedian *m, const void *ptr)
+{
+  // everything in lo is <= everything in hi
+  bool hi = m->nlo && m->compar(ptr, m->lo, m->arg) > 0;
+  _gca_runmed_push(m, hi, ptr);
+  if(m->nhi > m->nlo) _gca_runmed_move(m, true);
+  else if(m->nlo > m->nhi+1) _gca_runmed_move(m, false);
+}
+
+static inline void gca_runmed_add_n(GcaRunMedian *m, const void *ptr, size_t n)
+{
+  const char *src = (const char*)ptr;
+  size_t i;
+  for(i = 0; i < n; i++) gca_runmed_add(m, src + m->es*i);
+}
+
+// Add all the values in src to dst. src must not be dst
+static inline void gca_runmed_merge(GcaRunMedian *dst, const GcaRunMedian *src)
+{
+  assert(dst != src && dst->es == src->es);
+  gca_runmed_add_n(dst, src->lo, src->nlo);
+  gca_runmed_add_n(dst, src->hi, src->nhi);
+}
+
+//
+// KLL sketch
+//
+// Karnin, Lang & Liberty, "Optimal Quantile Approximation in Streams" (2016)
+// https://arxiv.org/abs/1603.05346
+//
+// Values are kept in levels; a value at level h stands for 2^h values. When a
+// level fills up it is sorted and every other value (odd or even positions, at
+// random) moves up a level, the rest are dropped. Level capacities shrink by
+// 2/3 going down from the top, which has capacity k, to a minimum of
+// GCA_KLL_MIN_CAP. Memory is O(k + log n) and the rank error is about 1.7/k
+// (k = 200 gives quantiles within ~1% in rank). min and max are exact.
+//
+
+#define GCA_KLL_DEFAULT_K 200
+
+typedef struct
+{
+  double *v;
+  size_t n, size, cap; // cap: compact once n reaches this
+} GcaKLLLevel;
+
+typedef struct
+{
+  const size_t k; // accuracy, size of the top level
+  uint64_t n; // number of values added
+  double min, max;
+  size_t nlevels, nstored, capacity; // capacity is the sum over levels
+  GcaKLLLevel *levels; // levels[0] takes new values
+  GcaRand r; // picks which half of a level moves up
+} GcaKLL;
+
+static inline void gca_kll_alloc(GcaKLL *s, size_t k, uint64_t seed) __attribute__((unused));
+static inline void gca_kll_dealloc(GcaKLL *s) __attribute__((unused));
+static inline void gca_kll_add(GcaKLL *s, double x) __attribute__((unused));
+static inline void gca_kll_add_n(GcaKLL *s, const double *x, size_t n) __attribute__((unused));
+static inline void gca_kll_merge(GcaKLL *dst, const GcaKLL *src) __attribute__((unused));
+static inline void gca_kll_quantiles(const GcaKLL *s, const double *qs,
+                                     double *out, size_t nq) __attribute__((unused));
+static inline double gca_kll_quantile(const GcaKLL *s, double q) __attribute__((unused));
+
+#define gca_kll_n(s) ((s)->n)
+
+// Smallest level capacity. Small levels compact often for little gain
+#define GCA_KLL_MIN_CAP 8
+
+// Add a level on top and recalculate capacities
+static inline void _gca_kll_add_level(GcaKLL *s)
+{
+  size_t h;
+  double c = (double)s->k;
+  s->levels = realloc(s->levels, (s->nlevels+1) * sizeof(GcaKLLLevel));
+  s->levels[s->nlevels++] = (GcaKLLLevel){.v = NULL, .n = 0, .size = 0};
+  for(h = s->nlevels, s->capacity = 0; h-- > 0; c *= 2.0/3.0) {
+    s->levels[h].cap = c < GCA_KLL_MIN_CAP ? GCA_KLL_MIN_CAP : (size_t)ceil(c);
+    s->capacity += s->levels[h].cap;
+  }
+}
+
+// k >= 8, or 0 for GCA_KLL_DEFAULT_K
+static inline void gca_kll_alloc(GcaKLL *s, size_t k, uint64_t seed)
+{
+  GcaKLL tmp = {.k = k ? (k < 8 ? 8 : k) : GCA_KLL_DEFAULT_K, .n = 0,
+                .min = INFINITY, .max = -INFINITY,
+                .nlevels = 0, .nstored = 0, .capacity = 0, .levels = NULL};
+  memcpy(s, &tmp, sizeof(GcaKLL));
+  gca_rand_seed(&s->r, seed);
+  _gca_kll_add_level(s);
+}
+
+static inline void gca_kll_dealloc(GcaKLL *s)
+{
+  size_t h;
+  for(h = 0; h < s->nlevels; h++) free(s->levels[h].v);
+  free(s->levels);
+  s->levels = NULL;
+  s->nlevels = 0;
+}
+
+static inline void _gca_kll_append(GcaKLLLevel *l, const double *x, size_t n)
+{
+  l->v = gca_capacity(l->v, &l->size, sizeof(double), l->n + n);
+  memcpy(l->v + l->n, x, n * sizeof(double));
+  l->n += n;
+}
+
+// Sort doubles without qsort()'s call per comparison; most of the time spent
+// adding values goes on sorting level 0
+static inline void _gca_kll_sort(double *v, size_t n)
+{
+  size_t i, j;
+  double a, b, c, p, t;
+  while(n > 16) {
+    // median of three pivot, partition, recurse on the smaller side
+    a = v[0]; b = v[n/2]; c = v[n-1];
+    p = a < b ? (b < c ? b : (a < c ? c : a)) : (a < c ? a : (b < c ? c : b));
+    for(i = 0, j = n-1; ; i++, j--) {
+      while(v[i] < p) i++;
+      while(v[j] > p) j--;
+      if(i >= j) break;
+      t = v[i]; v[i] = v[j]; v[j] = t;
+    }
+    if(j+1 < n-j-1) { _gca_kll_sort(v, j+1); v += j+1; n -= j+1; }
+    else { _gca_kll_sort(v+j+1, n-j-1); n = j+1; }
+  }
+  for(i = 1; i < n; i++) {
+    for(t = v[i], j = i; j > 0 && v[j-1] > t; j--) v[j] = v[j-1];
+    v[j] = t;
+  }
+}
+
+// Compact the lowest level that is over capacity, until we fit
+static inline void _gca_kll_compress(GcaKLL *s)
+{
+  size_t h, i, keep;
+  GcaKLLLevel *l;
+  while(s->nstored >= s->capacity) {
+    for(h = 0; s->levels[h].n < s->levels[h].cap; h++) {}
+    if(h+1 == s->nlevels) _gca_kll_add_level(s);
+    l = &s->levels[h];
+    _gca_kll_sort(l->v, l->n);
+    // odd one out stays at this level
+    keep = l->n & 1;
+    i = keep + (gca_rand_next(&s->r) >> 63);
+    for(; i < l->n; i += 2) _gca_kll_append(&s->levels[h+1], &l->v[i], 1);
+    s->nstored -= (l->n - keep) / 2;
+    l->n = keep;
+  }
+}
+
+static inline void gca_kll_add_n(GcaKLL *s, const double *x, size_t n)
+{
+  size_t i, m;
+  for(i = 0; i < n; i++) {
+    if(x[i] < s->min) s->min = x[i];
+    if(x[i] > s->max) s->max = x[i];
+  }
+  s->n += n;
+  // copy in as many as fit before compressing
+  for(; n > 0; n -= m, x += m) {
+    m = s->capacity - s->nstored;
+    if(m > n) m = n;
+    _gca_kll_append(&s->levels[0], x, m);
+    s->nstored += m;
+    _gca_kll_compress(s);
+  }
+}
+
+static inline void gca_kll_add(GcaKLL *s, double x)
+{
+  gca_kll_add_n(s, &x, 1);
+}
+
+// Add the values summarised by src to dst. src must not be dst
+static inline void gca_kll_merge(GcaKLL *dst, const GcaKLL *src)
+{
+  size_t h;
+  assert(dst != src);
+  while(dst->nlevels < src->nlevels) _gca_kll_add_level(dst);
+  for(h = 0; h < src->nlevels; h++) {
+    _gca_kll_append(&dst->levels[h], src->levels[h].v, src->levels[h].n);
+    dst->nstored += src->levels[h].n;
+  }
+  dst->n += src->n;
+  if(src->min < dst->min) dst->min = src->min;
+  if(src->max > dst->max) dst->max = src->max;
+  _gca_kll_compress(dst);
+}
+
+typedef struct { double x; uint64_t w; } _GcaKLLItem;
+
+static inline int _gca_kll_item_cmp(const void *a, const void *b)
+{
+  double x = ((const _GcaKLLItem*)a)->x, y = ((const _GcaKLLItem*)b)->x;
+  return (x > y) - (x < y);
+}
+
+// Estimate the qs[i]-quantile for i < nq, 0 <= qs[i] <= 1. Sorts the sketch
+// once, so ask for several quantiles together. NaN if no values were added.
+static inline void gca_kll_quantiles(const GcaKLL *s, const double *qs,
+                                     double *out, size_t nq)
+{
+  size_t h, i, j, nitems = 0;
+  uint64_t cum;
+  _GcaKLLItem *items = malloc(s->nstored * sizeof(_GcaKLLItem));
+
+  for(h = 0; h < s->nlevels; h++)
+    for(i = 0; i < s->levels[h].n; i++)
+      items[nitems++] = (_GcaKLLItem){.x = s->levels[h].v[i], .w = 1ULL << h};
+  qsort(items, nitems, sizeof(items[0]), _gca_kll_item_cmp);
+
+  for(j = 0; j < nq; j++) {
+    if(!s->n) { out[j] = NAN; continue; }
+    if(qs[j] <= 0) { out[j] = s->min; continue; }
+    if(qs[j] >= 1) { out[j] = s->max; continue; }
+    // first value whose total weight so far covers rank q*n
+    double target = qs[j] * (double)s->n;
+    for(i = 0, cum = 0; i+1 < nitems && (double)(cum += items[i].w) < target; i++) {}
+    out[j] = items[i].x;
+  }
+  free(items);
+}
+
+static inline double gca_kll_quantile(const GcaKLL *s, double q)
+{
+  double x;
+  gca_kll_quantiles(s, &q, &x, 1);
+  return x;
+}
+
+#endif /* QUANTILES_H_ */
@@ -0,0 +1,640 @@
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+#include "circ_array.h"
+#include "carrays.h"
+#include "multiqueue.h"
+#include "circ_spsc.h"
+#include "circ_mpmc.h"
+#include "carrays_mt.h"
+#include <sched.h>
+
+//
+// Benchmarks
+//
+// Usage: ./runbench [n]
+//   n is the number of elements to use in each benchmark
+//
+
+#define status(fmt,...) do { \
+  fprintf(stdout, "[%s:%i] "fmt"\n", __FILE__, __LINE__, ##__VA_ARGS__); \
+} while(0)
+
+static inline double now_secs()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+#define report(name,n,t) \
+  status("  %-24s %8.3f secs  %7.2f ns/el", name, t, (t)*1e9/(n))
+
+// Allocate array of n uint64_t where arr+1 is aligned to a 64 byte boundary
+static uint64_t* alloc_heap_array(size_t n, void **mem)
+{
+  if(posix_memalign(mem, 64, sizeof(uint64_t)*(n+8)) != 0) return NULL;
+  return (uint64_t*)*mem + 7;
+}
+
+typedef void (*heapfunc_t)(void *heap, size_t nel, size_t es,
+                           int (*compar)(const void *_a, const void *_b,
+                                         void *_arg),
+                           void *arg);
+
+static void bench_heap(const char *name, uint64_t *arr, const uint64_t *src,
+                       size_t n, heapfunc_t make, heapfunc_t pushup,
+                       heapfunc_t pop)
+{
+  size_t i;
+  double t0, t1, t2, t3, t4;
+  char title[100];
+
+  memcpy(arr, src, n*sizeof(arr[0]));
+  t0 = now_secs();
+  make(arr, n, sizeof(arr[0]), gca_cmp2_uint64, NULL);
+  t1 = now_secs();
+  for(i = n; i > 0; i--) pop(arr, i, sizeof(arr[0]), gca_cmp2_uint64, NULL);
+  t2 = now_secs();
+  if(!gca_is_sorted(arr, n, sizeof(arr[0]), gca_cmp2_uint64, NULL))
+    status("  %s: heap did not sort!", name);
+  memcpy(arr, src, n*sizeof(arr[0]));
+  t3 = now_secs();
+  for(i = 1; i <= n; i++) pushup(arr, i, sizeof(arr[0]), gca_cmp2_uint64, NULL);
+  t4 = now_secs();
+
+  sprintf(title, "%s make", name);   report(title, n, t1-t0);
+  sprintf(title, "%s pop", name);    report(title, n, t2-t1);
+  sprintf(title, "%s pushup", name); report(title, n, t4-t3);
+}
+
+// Shuffle n uint64_t
+void bench_shuffle(size_t n)
+{
+  uint64_t *arr = malloc(n * sizeof(uint64_t));
+  size_t i;
+  double t0, t1, t2, t3, t4;
+  GcaRand r;
+  gca_rand_seed(&r, time(NULL));
+  for(i = 0; i < n; i++) arr[i] = i;
+
+  status("Shuffle (%zu x uint64_t):", n);
+  t0 = now_secs();
+  gca_shuffle(arr, n, sizeof(uint64_t));
+  t1 = now_secs();
+  gca_shuffle_r(arr, n, sizeof(uint64_t), &r);
+  t2 = now_secs();
+  gca_shuffle_mt(arr, n, sizeof(uint64_t), &r, 1);
+  t3 = now_secs();
+  gca_shuffle_mt(arr, n, sizeof(uint64_t), &r, 0);
+  t4 = now_secs();
+  report("gca_shuffle (drand48)", n, t1-t0);
+  report("gca_shuffle_r", n, t2-t1);
+  report("gca_shuffle_mt 1 thread", n, t3-t2);
+  report("gca_shuffle_mt", n, t4-t3);
+  free(arr);
+}
+
+// Previous gca_reverse: swap pairs of elements byte by byte
+static void reverse_bytewise(void *_ptr, size_t n, size_t es)
+{
+  char *a = (char*)_ptr, *b = a + es*(n-1);
+  for(; a < b; a += es, b -= es) gca_swapm(a, b, es);
+}
+
+// Reverse n bytes worth of elements of various sizes
+void bench_reverse(size_t n)
+{
+  size_t sizes[] = {1, 2, 4, 8, 16, 12}, i, m, nel;
+  double t0, t1, t2, t3;
+  char *arr = malloc(n);
+  char title[100];
+  for(i = 0; i < n; i++) arr[i] = i;
+
+  status("Reverse (%zu bytes, bytewise / gca_reverse / gca_reverse_mt):", n);
+  for(m = 0; m < sizeof(sizes)/sizeof(sizes[0]); m++) {
+    nel = n / sizes[m];
+    t0 = now_secs();
+    reverse_bytewise(arr, nel, sizes[m]);
+    t1 = now_secs();
+    gca_reverse(arr, nel, sizes[m]);
+    t2 = now_secs();
+    gca_reverse_mt(arr, nel, sizes[m], 0);
+    t3 = now_secs();
+    sprintf(title, "es=%zu bytewise", sizes[m]);
+    report(title, nel, t1-t0);
+    sprintf(title, "es=%zu gca_reverse", sizes[m]);
+    report(title, nel, t2-t1);
+    sprintf(title, "es=%zu gca_reverse_mt", sizes[m]);
+    report(title, nel, t3-t2);
+  }
+  free(arr);
+}
+
+typedef void (*cyclefunc_t)(void *_ptr, size_t n, size_t es, size_t shift);
+
+// Rotate an array of n uint64_t by a few different shifts
+void bench_cycle(size_t n)
+{
+  cyclefunc_t funcs[] = {gca_cycle_left, gca_cycle_left_swap,
+                         gca_cycle_left_reverse, gca_cycle_left_juggle};
+  const char *names[] = {"cycle_left (auto)", "block swap", "reversal",
+                         "GCD juggling"};
+  size_t shifts[] = {3, n/3, n/2+1, n-40};
+  size_t f, i, s, total = 0;
+  double t0, t1;
+  uint64_t *arr = malloc(n * sizeof(uint64_t));
+  for(i = 0; i < n; i++) arr[i] = i;
+
+  status("Cycle shift (%zu x uint64_t, shift %zu, %zu, %zu, %zu):",
+         n, shifts[0], shifts[1], shifts[2], shifts[3]);
+  for(f = 0; f < sizeof(funcs)/sizeof(funcs[0]); f++) {
+    t0 = now_secs();
+    for(s = 0; s < 4; s++) funcs[f](arr, n, sizeof(uint64_t), shifts[s]);
+    t1 = now_secs();
+    total = (total + shifts[0] + shifts[1] + shifts[2] + shifts[3]) % n;
+    for(i = 0; i < n && arr[i] == (i+total) % n; i++) {}
+    if(i < n) status("  %s: wrong result!", names[f]);
+    report(names[f], 4*n, t1-t0);
+  }
+  free(arr);
+}
+
+void bench_reduce(size_t n)
+{
+  double *arr = malloc(n * sizeof(double)), lo, hi, sum = 0;
+  void *mn, *mx, *mn2, *mx2;
+  size_t i, idx = 0;
+  double t0, t1;
+  for(i = 0; i < n; i++) arr[i] = drand48();
+
+  status("Min / max / sum (%zu x double):", n);
+  t0 = now_secs();
+  mn = gca_min(arr, n, sizeof(double), gca_cmp2_double, NULL);
+  mx = gca_max(arr, n, sizeof(double), gca_cmp2_double, NULL);
+  t1 = now_secs();
+  report("gca_min + gca_max", n, t1-t0);
+
+  t0 = now_secs();
+  gca_minmax(arr, n, sizeof(double), gca_cmp2_double, NULL, &mn2, &mx2);
+  t1 = now_secs();
+  if(mn != mn2 || mx != mx2) status("  wrong result!");
+  report("gca_minmax", n, t1-t0);
+
+  t0 = now_secs();
+  gca_minmax_double(arr, n, &lo, &hi);
+  t1 = now_secs();
+  if(lo != *(double*)mn || hi != *(double*)mx) status("  wrong result!");
+  report("gca_minmax_double", n, t1-t0);
+
+  t0 = now_secs();
+  idx = gca_argmin_double(arr, n);
+  t1 = now_secs();
+  if(arr[idx] != lo) status("  wrong result!");
+  report("gca_argmin_double", n, t1-t0);
+
+  t0 = now_secs();
+  for(i = 0; i < n; i++) sum += arr[i];
+  t1 = now_secs();
+  report("sum loop", n, t1-t0);
+
+  t0 = now_secs();
+  sum -= gca_sum_double(arr, n);
+  t1 = now_secs();
+  if(fabs(sum) > 1e-6) status("  wrong result!");
+  report("gca_sum_double", n, t1-t0);
+  free(arr);
+}
+
+void bench_select(size_t n)
+{
+  double *arr = malloc(n * sizeof(double)), *tmp = malloc(n * sizeof(double));
+  double m1, m2;
+  size_t i;
+  double t0, t1;
+  for(i = 0; i < n; i++) arr[i] = drand48();
+
+  status("Median (%zu x double):", n);
+  t0 = now_secs();
+  memcpy(tmp, arr, n * sizeof(double));
+  m1 = gca_median_double(tmp, n);
+  t1 = now_secs();
+  report("memcpy + gca_median_double", n, t1-t0);
+
+  t0 = now_secs();
+  m2 = gca_median_ro_double(arr, n);
+  t1 = now_secs();
+  if(m1 != m2) status("  wrong result!");
+  report("gca_median_ro_double", n, t1-t0);
+  free(tmp);
+  free(arr);
+}
+
+// Intersect two sets of n/2 uint32_t drawn from [0,n), so about a quarter
+// of each matches, then a small set with a large one
+void bench_set_intersect(size_t n)
+{
+  size_t i, na = n/2, nsmall = n/1024, m1, m2;
+  uint32_t *a = malloc(na * sizeof(uint32_t)), *b = malloc(na * sizeof(uint32_t));
+  uint32_t *out = malloc(na * sizeof(uint32_t));
+  size_t *idx = malloc(na * sizeof(size_t));
+  double t0, t1;
+  GcaRand r;
+  gca_rand_seed(&r, time(NULL));
+  gca_sample_idx(idx, n, na, &r);
+  for(i = 0; i < na; i++) a[i] = idx[i];
+  gca_sample_idx(idx, n, na, &r);
+  for(i = 0; i < na; i++) b[i] = idx[i];
+  qsort(a, na, sizeof(uint32_t), gca_cmp_uint32);
+  qsort(b, na, sizeof(uint32_t), gca_cmp_uint32);
+
+  status("Set intersection (2 x %zu uint32_t):", na);
+  t0 = now_secs();
+  m1 = gca_set_intersect(a, na, b, na, sizeof(uint32_t), gca_cmp2_uint32, NULL, out);
+  t1 = now_secs();
+  report("gca_set_intersect", 2*na, t1-t0);
+
+  t0 = now_secs();
+  m2 = gca_set_intersect_uint32(a, na, b, na, out);
+  t1 = now_secs();
+  if(m1 != m2) status("  wrong result!");
+  report("gca_set_intersect_uint32", 2*na, t1-t0);
+
+  status("Set intersection (%zu and %zu uint32_t):", nsmall, na);
+  for(i = 0; i < nsmall; i++) b[i] = b[i*1024];
+  t0 = now_secs();
+  m1 = gca_set_intersect(b, nsmall, a, na, sizeof(uint32_t), gca_cmp2_uint32, NULL, out);
+  t1 = now_secs();
+  report("gca_set_intersect", nsmall, t1-t0);
+
+  t0 = now_secs();
+  m2 = gca_set_intersect_uint32(b, nsmall, a, na, out);
+  t1 = now_secs();
+  if(m1 != m2) status("  wrong result!");
+  report("gca_set_intersect_uint32", nsmall, t1-t0);
+  free(a); free(b); free(out); free(idx);
+}
+
+// Merge 256 sorted runs of uint64_t
+void bench_merge_k(size_t n)
+{
+  size_t i, k = 256, lens[256];
+  const void *runs[256];
+  uint64_t *arr = malloc(n * sizeof(uint64_t)), *out = malloc(n * sizeof(uint64_t));
+  double t0, t1;
+  for(i = 0; i < n; i++) arr[i] = lrand48();
+  for(i = 0; i < k; i++) {
+    runs[i] = arr + n*i/k;
+    lens[i] = n*(i+1)/k - n*i/k;
+    qsort(arr + n*i/k, lens[i], sizeof(uint64_t), gca_cmp_uint64);
+  }
+
+  status("K-way merge (%zu runs, %zu x uint64_t):", k, n);
+  t0 = now_secs();
+  gca_merge_k(runs, lens, k, sizeof(uint64_t), out, gca_cmp2_uint64, NULL);
+  t1 = now_secs();
+  if(!gca_is_sorted(out, n, sizeof(uint64_t), gca_cmp2_uint64, NULL))
+    status("  wrong result!");
+  report("gca_merge_k", n, t1-t0);
+
+  t0 = now_secs();
+  gca_qsort(arr, n, sizeof(uint64_t), gca_cmp2_uint64, NULL);
+  t1 = now_secs();
+  report("gca_qsort of all runs", n, t1-t0);
+  free(arr);
+  free(out);
+}
+
+// Visit every permutation of m values, m! <= n, reading the first and last
+// element of each
+void bench_perms(size_t n)
+{
+  size_t m, i, nperms, count, *p = NULL, *state = NULL;
+  uint64_t d[20], sum;
+  double t0, t1;
+  for(m = 1, nperms = 1; m < 20 && nperms * (m+1) <= n; m++) nperms *= m+1;
+
+  status("Permutations (all %zu! = %zu of %zu values):", m, nperms, m);
+  for(i = 0; i < m; i++) d[i] = i*i;
+
+  t0 = now_secs();
+  for(sum = count = 0; gca_itr_next(&p, m, NULL); count++) sum += d[p[0]] ^ d[p[m-1]];
+  t1 = now_secs();
+  if(count != nperms) status("  gca_itr_next: wrong count!");
+  report("gca_itr_next", nperms, t1-t0);
+
+  t0 = now_secs();
+  for(sum = count = 0; gca_itr_heap(&state, d, m, sizeof(d[0])); count++) sum += d[0] ^ d[m-1];
+  t1 = now_secs();
+  if(count != nperms) status("  gca_itr_heap: wrong count!");
+  report("gca_itr_heap", nperms, t1-t0);
+  free(state);
+  state = NULL;
+
+  t0 = now_secs();
+  for(sum = count = 0; gca_itr_sjt(&state, d, m, sizeof(d[0])); count++) sum += d[0] ^ d[m-1];
+  t1 = now_secs();
+  if(count != nperms) status("  gca_itr_sjt: wrong count!");
+  report("gca_itr_sjt", nperms, t1-t0);
+
+  if(sum == 1) status("  %zu", (size_t)sum); // use sum
+  free(p);
+  free(state);
+}
+
+void bench_heaps(size_t n)
+{
+  status("Heaps (%zu x uint64_t):", n);
+  void *mem = NULL;
+  uint64_t *arr = alloc_heap_array(n, &mem), *src = malloc(n*sizeof(src[0]));
+  size_t i;
+  if(!arr || !src) { fprintf(stderr, "Out of memory\n"); exit(EXIT_FAILURE); }
+  for(i = 0; i < n; i++) src[i] = ((uint64_t)lrand48() << 31) ^ lrand48();
+
+  bench_heap("binary", arr, src, n, gca_heap_make, gca_heap_pushup, gca_heap_pop);
+  bench_heap("4-ary",  arr, src, n, gca_heap4_make, gca_heap4_pushup, gca_heap4_pop);
+  bench_heap("8-ary",  arr, src, n, gca_heap8_make, gca_heap8_pushup, gca_heap8_pop);
+
+  free(mem);
+  free(src);
+}
+
+typedef struct {
+  GcaMQueue *mq;
+  size_t nops;
+  uint64_t seed;
+} MQBenchThread;
+
+static void* mq_bench_thread(void *ptr)
+{
+  MQBenchThread *t = (MQBenchThread*)ptr;
+  uint64_t v, x = t->seed;
+  size_t i;
+  for(i = 0; i < t->nops; i++) {
+    x = x * 6364136223846793005ULL + 1442695040888963407ULL;
+    v = x >> 16;
+    gca_mq_push(t->mq, &v);
+    gca_mq_pop(t->mq, &v);
+  }
+  return NULL;
+}
+
+// Throughput of push+pop pairs, scaling threads from 1 to nproc
+void bench_multiqueue(size_t n)
+{
+  long nproc = sysconf(_SC_NPROCESSORS_ONLN);
+  if(nproc < 1) nproc = 1; // unknown
+  size_t nthreads, i, m, nops = n/4 < 1000 ? 1000 : n/4;
+  uint64_t v;
+  double t0, t1;
+  char title[100];
+  const char *names[] = {"global lock", "multiqueue strict", "multiqueue relaxed"};
+  GcaMQueue mq;
+  MQBenchThread ts[nproc];
+  pthread_t pths[nproc];
+
+  status("Concurrent priority queue (%zu push+pop per thread, nproc=%li):",
+         nops, nproc);
+
+  for(nthreads = 1; nthreads <= (size_t)nproc; ) {
+    for(m = 0; m < 3; m++) {
+      gca_mq_alloc(&mq, sizeof(uint64_t), m ? 4*nthreads : 1, m < 2,
+                   gca_cmp2_uint64, NULL);
+      for(i = 0; i < 4096; i++) { v = lrand48(); gca_mq_push(&mq, &v); }
+      t0 = now_secs();
+      for(i = 0; i < nthreads; i++) {
+        ts[i] = (MQBenchThread){.mq = &mq, .nops = nops, .seed = lrand48()};
+        pthread_create(&pths[i], NULL, mq_bench_thread, &ts[i]);
+      }
+      for(i = 0; i < nthreads; i++) pthread_join(pths[i], NULL);
+      t1 = now_secs();
+      gca_mq_dealloc(&mq);
+      sprintf(title, "%s x%zu", names[m], nthreads);
+      status("  %-28s %8.3f secs  %7.2f Mops/s", title, t1-t0,
+             2*nops*nthreads / ((t1-t0)*1e6));
+    }
+    if(nthreads == (size_t)nproc) break;
+    nthreads = nthreads*2 < (size_t)nproc ? nthreads*2 : (size_t)nproc;
+  }
+}
+
+typedef struct {
+  CircSPSC *q; // SPSC queue or NULL to use circbuf with lock
+  CircBuf *circbuf;
+  pthread_mutex_t *lock;
+  size_t n, batch;
+} HandoffBench;
+
+static void* handoff_producer(void *ptr)
+{
+  HandoffBench *hb = (HandoffBench*)ptr;
+  uint64_t i, j, buf[64];
+  size_t n;
+  for(i = 0; i < hb->n; i += n) {
+    n = 0;
+    if(hb->q && hb->batch > 1) {
+      n = hb->n-i < hb->batch ? hb->n-i : hb->batch;
+      for(j = 0; j < n; j++) buf[j] = i+j;
+      n = circa_spsc_push_n(hb->q, buf, n);
+    }
+    else if(hb->q) n = circa_spsc_push(hb->q, &i);
+    else {
+      pthread_mutex_lock(hb->lock);
+      if(hb->circbuf->n < hb->circbuf->size) {
+        *(uint64_t*)circa_unshift(hb->circbuf) = i;
+        n = 1;
+      }
+      pthread_mutex_unlock(hb->lock);
+    }
+    if(!n) sched_yield(); // full, let the consumer run
+  }
+  return NULL;
+}
+
+static void handoff_consumer(HandoffBench *hb)
+{
+  uint64_t i, v, buf[64], sum = 0;
+  for(i = 0; i < hb->n; ) {
+    size_t n = 0;
+    if(hb->q && hb->batch > 1) n = circa_spsc_pop_n(hb->q, buf, hb->batch);
+    else if(hb->q) n = circa_spsc_pop(hb->q, &v);
+    else {
+      pthread_mutex_lock(hb->lock);
+      if(hb->circbuf->n) { v = *(uint64_t*)circa_pop(hb->circbuf); n = 1; }
+      pthread_mutex_unlock(hb->lock);
+    }
+    if(!n) sched_yield();
+    sum += n;
+    i += n;
+  }
+  if(sum != hb->n) status("  handoff lost elements!");
+}
+
+// Move n elements between two threads
+void bench_handoff(size_t n)
+{
+  CircSPSC q;
+  CircBuf circbuf;
+  pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+  pthread_t producer;
+  double t0, t1;
+  size_t m;
+  const char *names[] = {"mutex + CircBuf", "SPSC", "SPSC batch 64"};
+
+  status("Thread hand-off (%zu x uint64_t, capacity 1024):", n);
+  for(m = 0; m < 3; m++) {
+    circa_spsc_alloc(&q, sizeof(uint64_t), 1024);
+    circa_alloc(&circbuf, sizeof(uint64_t), 1024);
+    HandoffBench hb = {.q = m ? &q : NULL, .circbuf = &circbuf, .lock = &lock,
+                       .n = n, .batch = m == 2 ? 64 : 1};
+    t0 = now_secs();
+    pthread_create(&producer, NULL, handoff_producer, &hb);
+    handoff_consumer(&hb);
+    pthread_join(producer, NULL);
+    t1 = now_secs();
+    report(names[m], n, t1-t0);
+    circa_spsc_dealloc(&q);
+    circa_dealloc(&circbuf);
+  }
+}
+
+// Move n bytes through a pipe from one CircBuf to another, in chunks that
+// wrap around the end of both buffers
+void bench_pipe(size_t n)
+{
+  CircBuf src, dst;
+  int fds[2];
+  char *tmp;
+  size_t i, m, chunk = 12000; // less than the default pipe capacity
+  ssize_t r;
+  double t0, t1;
+  const char *names[] = {"copy + read/write", "readv/writev"};
+
+  if(pipe(fds) != 0) { status("pipe() failed, skipping"); return; }
+  tmp = malloc(chunk);
+  status("Pipe I/O (%zu bytes, %zu byte chunks):", n, chunk);
+  for(m = 0; m < 2; m++) {
+    circa_alloc(&src, 1, 1<<16);
+    circa_alloc(&dst, 1, 1<<16);
+    src.nozero = dst.nozero = true;
+    circa_append_n(&src, NULL, src.size);
+    t0 = now_secs();
+    for(i = 0; i < n; i += r) {
+      if(m) r = circa_writev_fd(&src, fds[1], chunk);
+      else {
+        circa_pop_n(&src, tmp, chunk);
+        r = write(fds[1], tmp, chunk);
+      }
+      circa_append_n(&src, NULL, chunk); // refill
+      if(r <= 0) break;
+      if(m) r = circa_readv_fd(&dst, fds[0], r);
+      else if((r = read(fds[0], tmp, r)) > 0) circa_append_n(&dst, tmp, r);
+      if(r <= 0) break;
+      circa_pop_n(&dst, NULL, r); // consume
+    }
+    t1 = now_secs();
+    if(i < n) status("  pipe I/O failed!");
+    report(names[m], n, t1-t0);
+    circa_dealloc(&src);
+    circa_dealloc(&dst);
+  }
+  free(tmp);
+  close(fds[0]);
+  close(fds[1]);
+}
+
+typedef struct {
+  CircMPMC *q;
+  size_t n, batch;
+} MPMCBench;
+
+#define MPMC_BENCH_END UINT64_MAX
+
+static void* mpmc_bench_producer(void *ptr)
+{
+  MPMCBench *mb = (MPMCBench*)ptr;
+  uint64_t buf[64] = {0};
+  size_t i, m;
+  for(i = 0; i < mb->n; i += m) {
+    m = mb->n-i < mb->batch ? mb->n-i : mb->batch;
+    circa_mpmc_push_n(mb->q, buf, m);
+  }
+  return NULL;
+}
+
+static void* mpmc_bench_consumer(void *ptr)
+{
+  MPMCBench *mb = (MPMCBench*)ptr;
+  uint64_t buf[64];
+  size_t i, m;
+  while(1) {
+    m = circa_mpmc_pop_n(mb->q, buf, mb->batch);
+    for(i = 0; i < m; i++) {
+      if(buf[i] == MPMC_BENCH_END) {
+        if(i+1 < m) circa_mpmc_push_n(mb->q, buf+i+1, m-i-1);
+        return NULL;
+      }
+    }
+  }
+}
+
+// Throughput of n elements through a MPMC queue
+void bench_mpmc(size_t n)
+{
+  const size_t configs[][2] = {{1,1}, {2,2}, {4,4}, {1,4}, {4,1}};
+  const size_t batches[] = {1, 16};
+  size_t c, b, i, np, nc;
+  uint64_t end = MPMC_BENCH_END;
+  CircMPMC q;
+  MPMCBench mb;
+  pthread_t prod[4], cons[4];
+  double t0, t1;
+  char title[100];
+
+  status("MPMC queue (%zu x uint64_t, capacity 1024, futex wait):", n);
+  for(b = 0; b < sizeof(batches)/sizeof(batches[0]); b++) {
+    for(c = 0; c < sizeof(configs)/sizeof(configs[0]); c++) {
+      np = configs[c][0];
+      nc = configs[c][1];
+      circa_mpmc_alloc(&q, sizeof(uint64_t), 1024, true);
+      mb = (MPMCBench){.q = &q, .n = n/np, .batch = batches[b]};
+      t0 = now_secs();
+      for(i = 0; i < nc; i++) pthread_create(&cons[i], NULL, mpmc_bench_consumer, &mb);
+      for(i = 0; i < np; i++) pthread_create(&prod[i], NULL, mpmc_bench_producer, &mb);
+      for(i = 0; i < np; i++) pthread_join(prod[i], NULL);
+      for(i = 0; i < nc; i++) circa_mpmc_push(&q, &end);
+      for(i = 0; i < nc; i++) pthread_join(cons[i], NULL);
+      t1 = now_secs();
+      circa_mpmc_dealloc(&q);
+      sprintf(title, "%zup x %zuc batch %zu", np, nc, batches[b]);
+      report(title, mb.n*np, t1-t0);
+    }
+  }
+}
+
+int main(int argc, char **argv)
+{
+  size_t n = 1UL<<22;
+  if(argc > 2 || (argc == 2 && (n = strtoul(argv[1], NULL, 10)) == 0)) {
+    fprintf(stderr, "usage: %s [n]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  srand48(time(NULL));
+
+  bench_shuffle(n);
+  bench_reverse(n * sizeof(uint64_t));
+  bench_cycle(n);
+  bench_reduce(n);
+  bench_select(n);
+  bench_set_intersect(n);
+  bench_merge_k(n);
+  bench_perms(n);
+  bench_heaps(n);
+  bench_multiqueue(n);
+  bench_handoff(n);
+  bench_pipe(n * sizeof(uint64_t));
+  bench_mpmc(n);
+
+  return EXIT_SUCCESS;
+}
@@ -1,10 +1,20 @@
 #include <stdio.h>
 #include "circ_array.h"
+#include "circ_deque.h"
+#include "circ_window.h"
+#include "quantiles.h"
+#include "pqueue.h"
+#include "multiqueue.h"
+#include "circ_spsc.h"
+#include "circ_mpmc.h"
+#include "carrays_mt.h"
 #include "carrays.h"
 
 // seeding random
 #include <sys/time.h> // for seeding random
 #include <unistd.h> // getpid()
+#include <fcntl.h> // fcntl()
+#include <sched.h> // sched_yield()
 
 size_t num_tests_run = 0, num_tests_failed = 0;
 
@@ -96,6 +106,13 @@ void test_GCD()
   TASSERT(gca_calc_GCD(3,6) == 3);
   TASSERT(gca_calc_GCD(100,120) == 20);
   TASSERT(gca_calc_GCD(100,125) == 25);
+
+  // 64 bit
+  TASSERT(gca_calc_GCD64(1ULL<<40, 1ULL<<35) == 1ULL<<35);
+  TASSERT(gca_calc_GCD64(3ULL<<40, 9ULL<<33) == 3ULL<<33);
+  TASSERT(gca_calc_GCD64((1ULL<<32)*7, 14) == 14);
+  TASSERT(gca_calc_GCD64(UINT64_MAX, 0) == UINT64_MAX);
+  TASSERT(gca_calc_GCD64(6700417ULL*641*3, 6700417ULL*5) == 6700417ULL);
 }
 
 void _test_cycle(size_t *arr, size_t n)
@@ -145,6 +162,455 @@ void test_cycle()
     _test_cycle(arr, n);
 }
 
+typedef void (*cyclefunc_t)(void *_ptr, size_t n, size_t es, size_t shift);
+
+// Check cycle left by every shift, for elements of size es (bytes 0..es-1)
+static size_t _test_cycle_method(cyclefunc_t func, unsigned char *arr,
+                                 size_t n, size_t es, size_t step)
+{
+  size_t i, shift, nerr = 0;
+  for(shift = 0; shift <= n; shift += step) {
+    for(i = 0; i < n*es; i++) arr[i] = (i/es)*7 + i%es;
+    func(arr, n, es, shift);
+    for(i = 0; i < n*es; i++)
+      nerr += (arr[i] != (unsigned char)(((i/es + shift) % n)*7 + i%es));
+  }
+  return nerr;
+}
+
+void test_cycle_methods()
+{
+  status("Testing array cycle methods...");
+  cyclefunc_t funcs[] = {gca_cycle_left, gca_cycle_left_swap,
+                         gca_cycle_left_reverse, gca_cycle_left_juggle};
+  size_t f, n, es, nerr = 0;
+  unsigned char *arr = malloc(3000*24);
+
+  for(f = 0; f < sizeof(funcs)/sizeof(funcs[0]); f++) {
+    for(n = 1; n < 70; n++)
+      for(es = 1; es <= 24; es += 1 + es/4)
+        nerr += _test_cycle_method(funcs[f], arr, n, es, 1);
+    // bigger than gca_cycle_left()'s buffer
+    nerr += _test_cycle_method(funcs[f], arr, 3000, 8, 97);
+    nerr += _test_cycle_method(funcs[f], arr, 2999, 24, 89);
+  }
+  TASSERT(nerr == 0);
+  free(arr);
+
+  // merge where all of src comes before dst uses a cycle shift
+  int m[10] = {5,6,7,8,9,0,1,2,3,4}, i;
+  gca_merge(m, 5, 5, sizeof(int), gca_cmp2_int, NULL);
+  for(i = 0; i < 10 && m[i] == i; i++) {}
+  TASSERT(i == 10);
+}
+
+void test_rand()
+{
+  status("Testing random number generator...");
+
+  GcaRand r = {.s = {1, 2, 3, 4}}, r2;
+  size_t i, j, counts[10] = {0}, perms[6] = {0};
+  uint64_t x;
+  int arr[3];
+
+  // reference xoshiro256** output
+  TASSERT(gca_rand_next(&r) == 11520);
+  TASSERT(gca_rand_next(&r) == 0);
+  TASSERT(gca_rand_next(&r) == 1509978240);
+  TASSERT(gca_rand_next(&r) == 1215971899390074240ULL);
+
+  // same seed gives the same stream, a jumped copy gives a different one
+  gca_rand_seed(&r, 42);
+  r2 = r;
+  TASSERT(gca_rand_next(&r) == gca_rand_next(&r2));
+  gca_rand_jump(&r2);
+  TASSERT(gca_rand_next(&r) != gca_rand_next(&r2));
+
+  // bounded values are in range and roughly uniform
+  for(i = 0; i < 100000; i++) {
+    x = gca_rand_bounded(&r, 10);
+    TASSERT(x < 10);
+    counts[x < 10 ? x : 0]++;
+  }
+  for(i = 0; i < 10; i++) TASSERT(counts[i] > 9000 && counts[i] < 11000);
+  TASSERT(gca_rand_bounded(&r, 1) == 0);
+  x = gca_rand_bounded(&r, UINT64_MAX);
+  TASSERT(x < UINT64_MAX);
+  for(i = 0; i < 1000; i++) {
+    double d = gca_rand_double(&r);
+    TASSERT(d >= 0 && d < 1);
+  }
+
+  // each of the 6 permutations of 3 elements is equally likely
+  for(i = 0; i < 60000; i++) {
+    arr[0] = 0; arr[1] = 1; arr[2] = 2;
+    gca_shuffle_r(arr, 3, sizeof(int), &r);
+    TASSERT(arr[0] + arr[1] + arr[2] == 3 && arr[0] != arr[1]);
+    perms[arr[0]*2 + (arr[1] > arr[2])]++;
+  }
+  for(i = 0; i < 6; i++) TASSERT(perms[i] > 9000 && perms[i] < 11000);
+
+  // shuffles are reproducible from a seed and keep all elements
+  #define N 1000
+  size_t a[N], b[N];
+  for(i = 0; i < N; i++) a[i] = b[i] = i;
+  gca_rand_seed(&r, 7);
+  gca_shuffle_r(a, N, sizeof(a[0]), &r);
+  gca_rand_seed(&r, 7);
+  gca_shuffle_r(b, N, sizeof(b[0]), &r);
+  for(i = 0; i < N && a[i] == b[i]; i++) {}
+  TASSERT(i == N);
+  qsort(a, N, sizeof(a[0]), gca_cmp_size);
+  for(i = 0; i < N && a[i] == i; i++) {}
+  TASSERT(i == N);
+
+  // sample moves m distinct elements to the front, odd sized elements
+  char c[N*3];
+  for(i = 0; i < N; i++) c[3*i] = c[3*i+1] = c[3*i+2] = i % 100;
+  gca_sample_r(c, 100, 3, 10, &r);
+  for(i = 0; i < 10; i++) {
+    TASSERT(c[3*i] == c[3*i+1] && c[3*i] == c[3*i+2]);
+    for(j = 0; j < i; j++) TASSERT(c[3*i] != c[3*j]);
+  }
+  gca_sample_r(c, 0, 3, 0, &r);
+  #undef N
+}
+
+void test_reservoir()
+{
+  status("Testing reservoir and index sampling...");
+
+  #define N 1000
+  GcaRand r, r2;
+  GcaReservoir rs, rs2;
+  size_t i, j, k, a[N], s[10], s2[10], counts[20] = {0}, idx[N];
+  bool seen[N];
+  for(i = 0; i < N; i++) a[i] = i;
+  gca_rand_seed(&r, 11);
+
+  // short stream: sample holds all of it in order
+  gca_reservoir_init(&rs, s, sizeof(size_t), 10, &r);
+  gca_reservoir_add_n(&rs, a, 4);
+  TASSERT(gca_reservoir_size(&rs) == 4);
+  for(i = 0; i < 4; i++) TASSERT(s[i] == i);
+
+  // feeding one at a time or in blocks gives the same sample
+  r2 = r;
+  gca_reservoir_init(&rs, s, sizeof(size_t), 10, &r);
+  gca_reservoir_init(&rs2, s2, sizeof(size_t), 10, &r2);
+  for(i = 0; i < N; i++) gca_reservoir_add(&rs, &a[i]);
+  for(i = 0; i < N; i += 77) gca_reservoir_add_n(&rs2, a+i, i+77 < N ? 77 : N-i);
+  TASSERT(gca_reservoir_size(&rs) == 10 && gca_reservoir_size(&rs2) == 10);
+  for(i = 0; i < 10 && s[i] == s2[i]; i++) {}
+  TASSERT(i == 10);
+  // distinct elements from the stream
+  qsort(s, 10, sizeof(size_t), gca_cmp_size);
+  for(i = 0; i < 10; i++) TASSERT(s[i] < N && (!i || s[i] > s[i-1]));
+
+  // each element is picked with probability m/n
+  for(i = 0; i < 20000; i++) {
+    TASSERT(gca_sample_copy(a, 20, sizeof(size_t), 5, s, &r) == 5);
+    for(j = 0; j < 5; j++) counts[s[j] < 20 ? s[j] : 0]++;
+  }
+  for(i = 0; i < 20; i++) TASSERT(counts[i] > 4500 && counts[i] < 5500);
+  // source array is untouched
+  for(i = 0; i < N && a[i] == i; i++) {}
+  TASSERT(i == N);
+  TASSERT(gca_sample_copy(a, 3, sizeof(size_t), 0, s, &r) == 0);
+
+  // Floyd's: m distinct indices in range, with and without the hash set
+  size_t ms[] = {0, 1, 10, 32, 33, 500, N};
+  for(k = 0; k < sizeof(ms)/sizeof(ms[0]); k++) {
+    gca_sample_idx(idx, N, ms[k], &r);
+    memset(seen, 0, sizeof(seen));
+    for(i = 0; i < ms[k]; i++) {
+      TASSERT(idx[i] < N && !seen[idx[i] < N ? idx[i] : 0]);
+      seen[idx[i] < N ? idx[i] : 0] = true;
+    }
+  }
+  memset(counts, 0, sizeof(counts));
+  for(i = 0; i < 20000; i++) {
+    gca_sample_idx(idx, 20, 5, &r);
+    for(j = 0; j < 5; j++) counts[idx[j] < 20 ? idx[j] : 0]++;
+  }
+  for(i = 0; i < 20; i++) TASSERT(counts[i] > 4500 && counts[i] < 5500);
+  #undef N
+}
+
+void test_weighted_sampling()
+{
+  status("Testing alias tables and weighted sampling...");
+
+  GcaRand r, r2;
+  GcaAlias t;
+  double w[] = {1, 2, 0, 3, 4}, bad[] = {1, -1}, zero[] = {0, 0};
+  size_t i, j, counts[5] = {0}, out[100], idx[5], k;
+  gca_rand_seed(&r, 3);
+
+  // bad weights
+  TASSERT(!gca_alias_alloc(&t, bad, 2));
+  TASSERT(!gca_alias_alloc(&t, zero, 2));
+  TASSERT(!gca_alias_alloc(&t, w, 0));
+
+  // draws are proportional to weight
+  TASSERT(gca_alias_alloc(&t, w, 5));
+  for(i = 0; i < 100000; i++) {
+    j = gca_alias_draw(&t, &r);
+    TASSERT(j < 5);
+    counts[j < 5 ? j : 2]++;
+  }
+  TASSERT(counts[2] == 0);
+  for(i = 0; i < 5; i++)
+    TASSERT(counts[i] >= w[i]*9500 && counts[i] <= w[i]*10500);
+
+  // batch draws are the same as one at a time
+  r2 = r;
+  gca_alias_draw_n(&t, out, 100, &r);
+  for(i = 0; i < 100 && out[i] == gca_alias_draw(&t, &r2); i++) {}
+  TASSERT(i == 100);
+  gca_alias_dealloc(&t);
+
+  // a single weight is always drawn
+  TASSERT(gca_alias_alloc(&t, w+3, 1));
+  for(i = 0; i < 100; i++) TASSERT(gca_alias_draw(&t, &r) == 0);
+  gca_alias_dealloc(&t);
+
+  // without replacement: distinct, never zero weight, stops at positive count
+  for(i = 0; i < 1000; i++) {
+    k = gca_sample_weighted(idx, w, 5, 5, &r);
+    TASSERT(k == 4);
+    for(j = 0; j < k; j++) {
+      TASSERT(idx[j] < 5 && idx[j] != 2);
+      TASSERT(j == 0 || idx[j] != idx[j-1]);
+    }
+  }
+  TASSERT(gca_sample_weighted(idx, w, 5, 0, &r) == 0);
+  TASSERT(gca_sample_weighted(idx, zero, 2, 2, &r) == 0);
+
+  // first index follows the weights, second the remaining weights
+  size_t first[5] = {0}, second[5] = {0};
+  for(i = 0; i < 100000; i++) {
+    TASSERT(gca_sample_weighted(idx, w, 5, 2, &r) == 2);
+    first[idx[0] < 5 ? idx[0] : 2]++;
+    if(idx[0] == 4) second[idx[1] < 5 ? idx[1] : 2]++;
+  }
+  for(i = 0; i < 5; i++)
+    TASSERT(first[i] >= w[i]*9500 && first[i] <= w[i]*10500);
+  // P(first=4) = 0.4, then P(second=3) = 3/6
+  TASSERT(second[3] > 19000 && second[3] < 21000);
+}
+
+void test_runmed()
+{
+  status("Testing running median...");
+
+  #define N 501
+  GcaRunMedian m, m2;
+  int vals[N], sorted[N];
+  size_t i, n;
+  GcaRand r;
+  gca_rand_seed(&r, 5);
+  for(i = 0; i < N; i++) vals[i] = gca_rand_bounded(&r, 100);
+
+  // compare with sorting after each value added
+  gca_runmed_alloc(&m, sizeof(int), gca_cmp2_int, NULL);
+  for(n = 1; n <= N; n++) {
+    gca_runmed_add(&m, &vals[n-1]);
+    memcpy(sorted, vals, n * sizeof(int));
+    qsort(sorted, n, sizeof(int), gca_cmp_int);
+    TASSERT(gca_runmed_n(&m) == n);
+    TASSERT(*(int*)gca_runmed_lo(&m) == sorted[(n-1)/2]);
+    TASSERT(*(int*)gca_runmed_hi(&m) == sorted[n/2]);
+  }
+
+  // merging two halves gives the same median
+  gca_runmed_alloc(&m2, sizeof(int), gca_cmp2_int, NULL);
+  gca_runmed_dealloc(&m);
+  gca_runmed_alloc(&m, sizeof(int), gca_cmp2_int, NULL);
+  gca_runmed_add_n(&m, vals, N/2);
+  gca_runmed_add_n(&m2, vals+N/2, N-N/2);
+  gca_runmed_merge(&m, &m2);
+  TASSERT(gca_runmed_n(&m) == N);
+  TASSERT(*(int*)gca_runmed_lo(&m) == sorted[N/2]);
+  gca_runmed_dealloc(&m);
+  gca_runmed_dealloc(&m2);
+  #undef N
+}
+
+void test_kll()
+{
+  status("Testing KLL quantile sketch...");
+
+  #define N 1000000
+  GcaKLL s, parts[4];
+  GcaRand r;
+  double *x = malloc(N * sizeof(double)), qs[] = {0, 0.01, 0.1, 0.5, 0.9, 0.99, 1};
+  double out[7], est;
+  size_t i, j, nq = sizeof(qs)/sizeof(qs[0]);
+
+  // empty, then small streams are exact
+  gca_kll_alloc(&s, 0, 1);
+  TASSERT(isnan(gca_kll_quantile(&s, 0.5)));
+  for(i = 0; i < 100; i++) gca_kll_add(&s, 99.0 - i);
+  TASSERT(gca_kll_n(&s) == 100);
+  TASSERT(gca_kll_quantile(&s, 0.5) == 49);
+  TASSERT(gca_kll_quantile(&s, 0.99) == 98);
+  gca_kll_dealloc(&s);
+
+  // a shuffled 0..N-1, so the value is the rank
+  gca_rand_seed(&r, 9);
+  for(i = 0; i < N; i++) x[i] = i;
+  gca_shuffle_r(x, N, sizeof(double), &r);
+
+  gca_kll_alloc(&s, 200, 2);
+  for(i = 0; i < N; i++) gca_kll_add(&s, x[i]);
+  TASSERT(s.nstored < 1000); // bounded memory
+  gca_kll_quantiles(&s, qs, out, nq);
+  TASSERT(out[0] == 0 && out[nq-1] == N-1);
+  for(j = 0; j < nq; j++) TASSERT(fabs(out[j] - qs[j]*N) < 0.015*N);
+  gca_kll_dealloc(&s);
+
+  // per-part sketches fed in blocks, then merged
+  for(j = 0; j < 4; j++) {
+    gca_kll_alloc(&parts[j], 200, 10+j);
+    for(i = j*N/4; i < (j+1)*N/4; i += 1000)
+      gca_kll_add_n(&parts[j], x+i, 1000);
+  }
+  for(j = 1; j < 4; j++) gca_kll_merge(&parts[0], &parts[j]);
+  TASSERT(gca_kll_n(&parts[0]) == N);
+  for(j = 0; j < nq; j++) {
+    est = gca_kll_quantile(&parts[0], qs[j]);
+    TASSERT(fabs(est - qs[j]*N) < 0.015*N);
+  }
+  for(j = 0; j < 4; j++) gca_kll_dealloc(&parts[j]);
+  free(x);
+  #undef N
+}
+
+// Compare typed reductions with simple loops, on arrays of every length up to
+// 600 holding values in [0,range) so that there are ties
+#define check_reduce(name,type_t,sum_t,range) do {                             \
+  type_t *arr = malloc(600 * sizeof(type_t)), lo, hi, elo, ehi;                \
+  size_t n, i, argmin, argmax;                                                 \
+  sum_t sum;                                                                   \
+  for(i = 0; i < 600; i++) arr[i] = (type_t)gca_rand_bounded(&r, range);       \
+  for(n = 1; n <= 600; n++) {                                                  \
+    elo = ehi = arr[0];                                                        \
+    argmin = argmax = 0;                                                       \
+    sum = 0;                                                                   \
+    for(i = 0; i < n; i++) {                                                   \
+      if(arr[i] < elo) { elo = arr[i]; argmin = i; }                           \
+      if(arr[i] > ehi) { ehi = arr[i]; argmax = i; }                           \
+      sum += arr[i];                                                           \
+    }                                                                          \
+    gca_minmax_##name(arr, n, &lo, &hi);                                       \
+    TASSERT(lo == elo && hi == ehi);                                           \
+    TASSERT(gca_argmin_##name(arr, n) == argmin);                              \
+    TASSERT(gca_argmax_##name(arr, n) == argmax);                              \
+    TASSERT(gca_sum_##name(arr, n) == sum);                                    \
+  }                                                                            \
+  TASSERT(gca_sum_##name(arr, 0) == 0);                                        \
+  TASSERT(gca_argmin_##name(arr, 0) == 0);                                     \
+  free(arr);                                                                   \
+} while(0)
+
+void test_reductions()
+{
+  status("Testing typed reductions...");
+
+  GcaRand r;
+  gca_rand_seed(&r, 13);
+
+  check_reduce(int32,  int32_t,  int64_t,  1000);
+  check_reduce(uint32, uint32_t, uint64_t, UINT32_MAX);
+  check_reduce(int64,  int64_t,  int64_t,  1UL<<40);
+  check_reduce(uint64, uint64_t, uint64_t, UINT64_MAX);
+  // small integers, so sums are exact in any order
+  check_reduce(float,  float,    double,   100);
+  check_reduce(double, double,   double,   1000);
+
+  // negative values
+  int32_t neg[] = {-5, 3, -7, -7, 2};
+  int64_t nlo, nhi;
+  int32_t lo32, hi32;
+  gca_minmax_int32(neg, 5, &lo32, &hi32);
+  TASSERT(lo32 == -7 && hi32 == 3);
+  TASSERT(gca_argmin_int32(neg, 5) == 2);
+  TASSERT(gca_sum_int32(neg, 5) == -14);
+  int64_t neg64[] = {-1, INT64_MIN, INT64_MAX};
+  gca_minmax_int64(neg64, 3, &nlo, &nhi);
+  TASSERT(nlo == INT64_MIN && nhi == INT64_MAX);
+  TASSERT(gca_sum_int64(neg64, 3) == -2);
+
+  // 32 bit sums don't overflow
+  uint32_t big[] = {UINT32_MAX, UINT32_MAX};
+  TASSERT(gca_sum_uint32(big, 2) == 2ULL*UINT32_MAX);
+
+  // pairwise float sum is more accurate than adding in order
+  #define N 1000000
+  float *f = malloc(N * sizeof(float)), naive = 0;
+  size_t i;
+  for(i = 0; i < N; i++) { f[i] = 0.1f; naive += f[i]; }
+  double exact = (double)0.1f * N;
+  TASSERT(fabs(gca_sum_float(f, N) - exact) < 1e-6 * exact);
+  TASSERT(fabs(naive - exact) > 1e-3 * exact);
+  free(f);
+  #undef N
+
+  // generic minmax matches gca_min / gca_max, ties go to the first
+  int vals[50];
+  void *mn, *mx;
+  size_t n;
+  for(i = 0; i < 50; i++) vals[i] = gca_rand_bounded(&r, 5);
+  for(n = 1; n <= 50; n++) {
+    gca_minmax(vals, n, sizeof(int), gca_cmp2_int, NULL, &mn, &mx);
+    TASSERT(mn == gca_min(vals, n, sizeof(int), gca_cmp2_int, NULL));
+    TASSERT(mx == gca_max(vals, n, sizeof(int), gca_cmp2_int, NULL));
+  }
+}
+
+void test_shuffle_mt()
+{
+  status("Testing multithreaded shuffle...");
+
+  // big enough to be split into buckets, and between three threads
+  size_t i, j, n = 3*GCA_MT_MIN_BYTES/sizeof(uint64_t) + 3, nthreads;
+  size_t quarters[4][4] = {{0}}, nerr = 0;
+  uint64_t *a = malloc(n * sizeof(uint64_t)), *b = malloc(n * sizeof(uint64_t));
+  GcaRand r, r2;
+
+  for(nthreads = 1; nthreads <= 3; nthreads++) {
+    gca_rand_seed(&r, nthreads);
+    r2 = r;
+    for(i = 0; i < n; i++) a[i] = b[i] = i;
+    gca_shuffle_mt(a, n, sizeof(uint64_t), &r, nthreads);
+    gca_shuffle_mt(b, n, sizeof(uint64_t), &r2, nthreads);
+    // reproducible
+    for(i = 0; i < n && a[i] == b[i]; i++) {}
+    TASSERT(i == n);
+    // elements from each quarter spread evenly over the output quarters
+    for(i = 0; i < n; i++) quarters[a[i]*4/n][i*4/n]++;
+    // a permutation
+    qsort(a, n, sizeof(uint64_t), gca_cmp_uint64);
+    for(i = 0; i < n && a[i] == i; i++) {}
+    TASSERT(i == n);
+  }
+  for(i = 0; i < 4; i++)
+    for(j = 0; j < 4; j++)
+      nerr += (quarters[i][j] < 3*n/16 - 3*n/16/20 || quarters[i][j] > 3*n/16 + 3*n/16/20);
+  TASSERT(nerr == 0);
+
+  // odd element size and a small array that isn't split
+  char *c = malloc(n*3);
+  for(i = 0; i < n*3; i++) c[i] = i/3;
+  gca_shuffle_mt(c, n, 3, &r, 2);
+  for(i = 0; i < n && c[3*i] == c[3*i+1] && c[3*i] == c[3*i+2]; i++) {}
+  TASSERT(i == n);
+  gca_shuffle_mt(c, 10, 3, &r, 2);
+  gca_shuffle_mt(c, 0, 3, &r, 0);
+  free(a); free(b); free(c);
+}
+
 void test_reverse()
 {
   status("Testing array reverse...");
@@ -158,6 +624,34 @@ void test_reverse()
     TASSERT(i == n);
   }
   #undef N
+
+  // every element size, odd and even lengths either side of the block size
+  size_t es, j, nerr = 0;
+  unsigned char *arr = malloc(100*40);
+  for(es = 1; es <= 40; es++) {
+    for(n = 0; n < 100; n += (n < 40 ? 1 : 7)) {
+      for(i = 0; i < n*es; i++) arr[i] = i;
+      gca_reverse(arr, n, es);
+      for(i = 0; i < n; i++)
+        for(j = 0; j < es; j++)
+          nerr += (arr[i*es+j] != (unsigned char)((n-1-i)*es+j));
+    }
+  }
+  TASSERT(nerr == 0);
+  free(arr);
+
+  // multithreaded, with a small array and one big enough to split
+  size_t nthreads, big = 3*GCA_MT_MIN_BYTES/sizeof(uint32_t) + 5;
+  uint32_t *arr32 = malloc(big * sizeof(uint32_t));
+  for(nthreads = 0; nthreads <= 4; nthreads++) {
+    for(n = 101; n <= big; n += big-101) {
+      for(i = 0; i < n; i++) arr32[i] = i;
+      gca_reverse_mt(arr32, n, sizeof(uint32_t), nthreads);
+      for(i = 0; i < n && arr32[i] == n-1-i; i++) {}
+      TASSERT(i == n);
+    }
+  }
+  free(arr32);
 }
 
 void test_bsearch()
@@ -316,11 +810,879 @@ void test_heapsort()
       gca_heap_make(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
       gca_heap_sort(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
       TASSERT(gca_is_sorted(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL));
+      for(j = 0; j < n && arr[j] == j; j++) {}
+      TASSERT(j == n);
+    }
+
+    // pop elements off one at a time
+    gca_shuffle(arr, n, sizeof(arr[0]));
+    gca_heap_make(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+    for(j = n; j > 0; j--) {
+      gca_heap_pop(arr, j, sizeof(arr[0]), gca_cmp2_int, NULL);
+      TASSERT(arr[j-1] == j-1);
     }
   }
   #undef N
 }
 
+// check every element is <= its parent
+bool check_heapd(int *arr, int n, int d)
+{
+  int i;
+  for(i = 1; i < n && arr[(i-1)/d] >= arr[i]; i++) {}
+  return i >= n;
+}
+
+void test_heapd_sort()
+{
+  status("Testing 4-ary and 8-ary heaps...");
+
+  #define N 200
+  int i, j, n, arr[N];
+
+  for(n = 0; n <= N; n++)
+  {
+    // heapsort shuffled arrays
+    for(j = 0; j < n; j++) arr[j] = j;
+    for(i = 0; i < 10; i++) {
+      gca_shuffle(arr, n, sizeof(arr[0]));
+      gca_heap4_make(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      TASSERT(check_heapd(arr, n, 4));
+      gca_heap4_sort(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      for(j = 0; j < n && arr[j] == j; j++) {}
+      TASSERT(j == n);
+
+      gca_shuffle(arr, n, sizeof(arr[0]));
+      gca_heap8_make(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      TASSERT(check_heapd(arr, n, 8));
+      gca_heap8_sort(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      for(j = 0; j < n && arr[j] == j; j++) {}
+      TASSERT(j == n);
+    }
+
+    // push elements on one at a time, then pop them off
+    gca_shuffle(arr, n, sizeof(arr[0]));
+    for(j = 1; j <= n; j++)
+      gca_heap4_pushup(arr, j, sizeof(arr[0]), gca_cmp2_int, NULL);
+    TASSERT(check_heapd(arr, n, 4));
+    for(j = n; j > 0; j--) {
+      gca_heap4_pop(arr, j, sizeof(arr[0]), gca_cmp2_int, NULL);
+      TASSERT(arr[j-1] == j-1);
+    }
+
+    gca_shuffle(arr, n, sizeof(arr[0]));
+    for(j = 1; j <= n; j++)
+      gca_heap8_pushup(arr, j, sizeof(arr[0]), gca_cmp2_int, NULL);
+    TASSERT(check_heapd(arr, n, 8));
+    for(j = n; j > 0; j--) {
+      gca_heap8_pop(arr, j, sizeof(arr[0]), gca_cmp2_int, NULL);
+      TASSERT(arr[j-1] == j-1);
+    }
+
+    // replace the top and push it down
+    if(n) {
+      gca_heap8_make(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      arr[0] = -1;
+      gca_heap8_pushdwn(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      TASSERT(check_heapd(arr, n, 8));
+      gca_heap4_make(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      arr[0] = -2;
+      gca_heap4_pushdwn(arr, n, sizeof(arr[0]), gca_cmp2_int, NULL);
+      TASSERT(check_heapd(arr, n, 4));
+    }
+  }
+  #undef N
+}
+
+
+// check min-max heap property against every ancestor
+bool check_mmheap(int *arr, int n)
+{
+  int i, a, lvl;
+  for(i = 1; i < n; i++) {
+    for(a = i, lvl = 0; a > 0; a = (a-1)/2) lvl++;
+    // walk ancestors, alternating min and max levels
+    for(a = (i-1)/2, lvl--; ; a = (a-1)/2, lvl--) {
+      if(lvl % 2 == 0 && arr[a] > arr[i]) return false;
+      if(lvl % 2 == 1 && arr[a] < arr[i]) return false;
+      if(a == 0) break;
+    }
+  }
+  return true;
+}
+
+void test_mmheap()
+{
+  status("Testing min-max heap...");
+
+  #define N 200
+  int i, j, n, arr[N], *ptr;
+  const size_t es = sizeof(arr[0]);
+
+  for(n = 0; n <= N; n++)
+  {
+    for(j = 0; j < n; j++) arr[j] = j;
+    gca_shuffle(arr, n, es);
+    gca_mmheap_make(arr, n, es, gca_cmp2_int, NULL);
+    TASSERT(check_mmheap(arr, n));
+    if(n) {
+      ptr = gca_mmheap_min(arr, n, es, gca_cmp2_int, NULL);
+      TASSERT(*ptr == 0);
+      ptr = gca_mmheap_max(arr, n, es, gca_cmp2_int, NULL);
+      TASSERT(*ptr == n-1);
+    }
+
+    // pop from alternating ends
+    int lo = 0, hi = n-1;
+    for(j = n; j > 0; j--) {
+      if(lrand48() & 1) {
+        gca_mmheap_popmin(arr, j, es, gca_cmp2_int, NULL);
+        TASSERT(arr[j-1] == lo++);
+      } else {
+        gca_mmheap_popmax(arr, j, es, gca_cmp2_int, NULL);
+        TASSERT(arr[j-1] == hi--);
+      }
+      TASSERT(check_mmheap(arr, j-1));
+    }
+
+    // push one at a time
+    for(j = 0; j < n; j++) arr[j] = j;
+    gca_shuffle(arr, n, es);
+    for(j = 1; j <= n; j++) {
+      gca_mmheap_pushup(arr, j, es, gca_cmp2_int, NULL);
+      TASSERT(check_mmheap(arr, j));
+    }
+    for(i = 0; i < n; i++) {
+      gca_mmheap_popmax(arr, n-i, es, gca_cmp2_int, NULL);
+      TASSERT(arr[n-i-1] == n-i-1);
+    }
+  }
+  #undef N
+}
+
+void test_pqueue()
+{
+  status("Testing indexed priority queue...");
+
+  #define N 200
+  GcaPQ pq;
+  int i, j, v, *ptr, max, init[N], vals[N]; // vals[h] is value of handle h
+  bool inq[N]; // inq[h] is true if handle h is in the queue
+  size_t h, handles[N], t;
+
+  for(t = 0; t < 10; t++)
+  {
+    gca_pq_alloc(&pq, sizeof(int), 4, gca_cmp2_int, NULL);
+    memset(inq, 0, sizeof(inq));
+
+    // bulk push into an empty queue, then push one at a time
+    for(i = 0; i < N/2; i++) init[i] = lrand48() % 1000;
+    gca_pq_push_n(&pq, init, N/2, handles);
+    for(i = 0; i < N/2; i++) { vals[handles[i]] = init[i]; inq[handles[i]] = true; }
+    for(i = 0; i < N/4; i++) {
+      v = lrand48() % 1000;
+      h = gca_pq_push(&pq, &v);
+      TASSERT(h < N && !inq[h]);
+      vals[h] = v; inq[h] = true;
+    }
+    // small bulk push into a big queue
+    gca_pq_push_n(&pq, init, 4, handles);
+    for(i = 0; i < 4; i++) { vals[handles[i]] = init[i]; inq[handles[i]] = true; }
+    TASSERT(pq.n == N/2 + N/4 + 4);
+
+    // randomly re-prioritise and remove elements
+    for(i = 0; i < 500; i++) {
+      h = lrand48() % N;
+      TASSERT(gca_pq_contains(&pq, h) == inq[h]);
+      if(!inq[h]) continue;
+      TASSERT(*(int*)gca_pq_get(&pq, h) == vals[h]);
+      switch(lrand48() % 4) {
+        case 0:
+          v = vals[h] + lrand48() % 100;
+          gca_pq_increase_key(&pq, h, &v);
+          vals[h] = v;
+          break;
+        case 1:
+          v = vals[h] - lrand48() % 100;
+          gca_pq_decrease_key(&pq, h, &v);
+          vals[h] = v;
+          break;
+        case 2:
+          *(int*)gca_pq_get(&pq, h) = vals[h] = lrand48() % 1000;
+          gca_pq_update(&pq, h);
+          break;
+        case 3:
+          ptr = gca_pq_remove(&pq, h);
+          TASSERT(*ptr == vals[h]);
+          inq[h] = false;
+          break;
+      }
+      // top must be the max
+      for(j = 0, max = INT32_MIN; j < N; j++) if(inq[j] && vals[j] > max) max = vals[j];
+      TASSERT(pq.n == 0 || *(int*)gca_pq_peek(&pq) == max);
+    }
+
+    // pop everything off in order
+    for(max = INT32_MAX; pq.n > 0; ) {
+      h = gca_pq_top(&pq);
+      ptr = gca_pq_pop(&pq);
+      TASSERT(inq[h] && *ptr <= max && *ptr == vals[h]);
+      max = *ptr;
+      inq[h] = false;
+    }
+    for(i = 0; i < N && !inq[i]; i++) {}
+    TASSERT(i == N);
+
+    gca_pq_dealloc(&pq);
+  }
+  #undef N
+}
+
+// check circular array holds values first..first+n-1
+bool check_circbuf(CircBuf *l, int first, size_t n)
+{
+  size_t i;
+  if(l->n != n) return false;
+  for(i = 0; i < n && *(int*)circa_get(l, i) == first+(int)i; i++) {}
+  return i == n;
+}
+
+void test_circbuf()
+{
+  status("Testing circular array...");
+
+  #define N 100
+  CircBuf l;
+  int i, arr[N], out[N];
+  void *seg1, *seg2;
+  size_t n1, t;
+
+  for(i = 0; i < N; i++) arr[i] = i;
+
+  // single element calls, growing from a small buffer while wrapped
+  circa_alloc(&l, sizeof(int), 4);
+  for(i = 0; i < 10; i++) *(int*)circa_unshift(&l) = 10+i; // end
+  for(i = 9; i >= 0; i--) *(int*)circa_push(&l) = i; // start
+  TASSERT(check_circbuf(&l, 0, 20));
+  TASSERT(*(int*)circa_pop(&l) == 0);
+  TASSERT(*(int*)circa_shift(&l) == 19);
+  TASSERT(check_circbuf(&l, 1, 18));
+  TASSERT(*(int*)circa_push(&l) == 0); // new elements are zero'd
+  circa_norm(&l);
+  TASSERT(l.start + l.n <= l.size);
+  TASSERT(check_circbuf(&l, 0, 19));
+  circa_dealloc(&l);
+
+  // bulk calls
+  for(t = 0; t < 20; t++) {
+    circa_alloc(&l, sizeof(int), 8);
+    l.start = t % 8; // vary where we wrap around
+    circa_append_n(&l, arr+40, 30);
+    circa_push_n(&l, arr+10, 30);
+    TASSERT(check_circbuf(&l, 10, 60));
+    circa_append_n(&l, NULL, 5);
+    for(i = 0; i < 5; i++) TASSERT(*(int*)circa_get(&l, 60+i) == 0);
+    TASSERT(circa_pop_n(&l, out, 25) == 25);
+    for(i = 0; i < 25 && out[i] == 10+i; i++) {}
+    TASSERT(i == 25);
+    TASSERT(l.n == 40);
+    TASSERT(*(int*)circa_get(&l, 0) == 35 && *(int*)circa_get(&l, 34) == 69);
+    TASSERT(circa_pop_n(&l, NULL, 5) == 5);
+    TASSERT(circa_pop_n(&l, out, 100) == 35);
+    for(i = 0; i < 30 && out[i] == 40+i; i++) {}
+    TASSERT(i == 30);
+    TASSERT(l.n == 0);
+
+    // spans cover the wrap point
+    l.start = l.size - 3;
+    circa_append_n(&l, arr, 10);
+    n1 = circa_spans(&l, 1, 9, &seg1, &seg2);
+    TASSERT(n1 == 2 && seg1 == circa_get(&l, 1) && seg2 == l.b);
+    TASSERT(*(int*)seg1 == 1 && *(int*)seg2 == 3);
+    n1 = circa_spans(&l, 4, 6, &seg1, &seg2);
+    TASSERT(n1 == 6 && *(int*)seg1 == 4);
+    circa_dealloc(&l);
+  }
+
+  // nozero leaves new elements as they were
+  circa_alloc(&l, sizeof(int), 8);
+  l.nozero = true;
+  circa_append_n(&l, arr+1, 8);
+  circa_pop_n(&l, NULL, 8);
+  circa_append_n(&l, NULL, 8);
+  TASSERT(check_circbuf(&l, 1, 8));
+  circa_dealloc(&l);
+  #undef N
+}
+
+void test_circbuf_mirror()
+{
+  status("Testing mirrored circular array...");
+
+  CircBuf l;
+  int i, *arr;
+  size_t size;
+
+  // a zeroed CircBuf is a plain (empty) heap buffer: dealloc must not close fd 0
+  CircBuf z = {.el = sizeof(int)};
+  int fdflags = fcntl(0, F_GETFD);
+  circa_dealloc(&z);
+  TASSERT(fcntl(0, F_GETFD) == fdflags);
+
+  if(!circa_alloc_mirror(&l, sizeof(int), 10)) {
+    status("  mirrored buffers not supported, skipping");
+    return;
+  }
+  size = l.size;
+  TASSERT(size >= 10 && (size * sizeof(int)) % sysconf(_SC_PAGESIZE) == 0);
+
+  // fill, then move the start so the contents wrap around the end
+  for(i = 0; i < (int)size; i++) *(int*)circa_unshift(&l) = i;
+  circa_pop_n(&l, NULL, size/2);
+  for(i = 0; i < (int)size/2; i++) *(int*)circa_unshift(&l) = size+i;
+  TASSERT(l.start + l.n > l.size);
+
+  // contents are contiguous from the first element
+  arr = circa_get(&l, 0);
+  for(i = 0; i < (int)size && arr[i] == (int)size/2+i; i++) {}
+  TASSERT(i == (int)size);
+  TASSERT(circa_spans(&l, 0, l.n, NULL, NULL) < l.n);
+
+  // sort and search in place
+  gca_reverse(arr, l.n, sizeof(int));
+  gca_qsort(arr, l.n, sizeof(int), gca_cmp2_int, NULL);
+  TASSERT(check_circbuf(&l, size/2, size));
+  i = size;
+  TASSERT(gca_bsearch(arr, l.n, sizeof(int), gca_search_int, &i) == &arr[size/2]);
+
+  // grow while wrapped
+  for(i = 0; i < (int)size; i++) *(int*)circa_unshift(&l) = size/2+size+i;
+  TASSERT(l.size == 2*size);
+  TASSERT(check_circbuf(&l, size/2, 2*size));
+  arr = circa_get(&l, 0);
+  for(i = 0; i < (int)(2*size) && arr[i] == (int)size/2+i; i++) {}
+  TASSERT(i == (int)(2*size));
+
+  // norm does nothing
+  size = l.start;
+  circa_norm(&l);
+  TASSERT(l.start == size);
+
+  circa_dealloc(&l);
+}
+
+void test_circbuf_shrink()
+{
+  status("Testing circular array shrinking...");
+
+  CircBuf l;
+  int i, *x, arr[64];
+  size_t t, size, min, nshrink;
+  for(i = 0; i < 64; i++) arr[i] = i;
+
+  // t == 0: realloc, t == 1: madvise, t == 2: mirrored
+  for(t = 0; t < 3; t++) {
+    if(t < 2) circa_alloc(&l, sizeof(int), 8);
+    else if(!circa_alloc_mirror(&l, sizeof(int), 8)) break;
+    min = l.size;
+    l.shrink = (GcaShrink){.minsize = 16, .factor = 4, .madvise = (t == 1)};
+
+    // grow while wrapped, then remove from both ends
+    l.start = l.size - 1;
+    for(i = 0; i < 5000; i++) *(int*)circa_unshift(&l) = i;
+    TASSERT(l.size == (8192 > min ? 8192 : min));
+    for(i = 0; i < 1000; i++) TASSERT(*(int*)circa_pop(&l) == i);
+    TASSERT(l.size == (8192 > min ? 8192 : min));
+    for(i = 4999, nshrink = 0; i >= 1100; i--) {
+      size = l.size;
+      x = circa_shift(&l);
+      TASSERT(*x == i); // removed element is still readable
+      nshrink += (l.size < size);
+      TASSERT(l.n*4 >= l.size || l.size == (16 > min ? 16 : min));
+      if(i % 97 == 0) TASSERT(check_circbuf(&l, 1000, i-1000));
+    }
+    TASSERT(check_circbuf(&l, 1000, 100));
+    TASSERT(nshrink > 0 || min >= 8192);
+    TASSERT(l.size == (256 > min ? 256 : min));
+
+    // bulk removal shrinks too, but not below minsize
+    TASSERT(circa_pop_n(&l, NULL, 96) == 96);
+    TASSERT(check_circbuf(&l, 1096, 4));
+    TASSERT(l.size == (16 > min ? 16 : min));
+    circa_pop_n(&l, NULL, 4);
+    TASSERT(l.size == (16 > min ? 16 : min));
+
+    // grow again, no policy, then shrink explicitly
+    l.shrink.factor = 0;
+    circa_append_n(&l, arr, 64);
+    circa_pop_n(&l, NULL, 61);
+    TASSERT(l.size == (64 > min ? 64 : min));
+    circa_push_n(&l, arr, 2);
+    circa_shrink_to_fit(&l);
+    TASSERT(l.size == (8 > min ? 8 : min));
+    TASSERT(*(int*)circa_pop(&l) == 0 && *(int*)circa_pop(&l) == 1);
+    TASSERT(check_circbuf(&l, 61, 3));
+    circa_dealloc(&l);
+  }
+
+  // emptying the buffer must leave start inside the smaller buffer
+  circa_alloc(&l, sizeof(int), 8);
+  l.shrink = (GcaShrink){.minsize = 2, .factor = 4, .madvise = false};
+  circa_append_n(&l, arr, 2);
+  TASSERT(circa_pop_n(&l, NULL, 2) == 2);
+  TASSERT(l.n == 0 && l.size == 2 && l.start < l.size);
+  *(int*)circa_unshift(&l) = 7;
+  TASSERT(*(int*)circa_pop(&l) == 7);
+  circa_dealloc(&l);
+
+  // flat arrays
+  int *b = NULL;
+  size_t bsize = 0;
+  GcaShrink p = {.minsize = 8, .factor = 4, .madvise = false};
+  b = gca_capacity(b, &bsize, sizeof(int), 4096);
+  for(i = 0; i < 64; i++) b[i] = i;
+  b = gca_shrink(b, &bsize, sizeof(int), 1024, p);
+  TASSERT(bsize == 4096);
+  b = gca_shrink(b, &bsize, sizeof(int), 64, p);
+  TASSERT(bsize == 128);
+  for(i = 0; i < 64 && b[i] == i; i++) {}
+  TASSERT(i == 64);
+  b = gca_shrink(b, &bsize, sizeof(int), 0, p);
+  TASSERT(bsize == 8);
+  p.madvise = true;
+  b = gca_capacity(b, &bsize, sizeof(int), 4096);
+  x = b;
+  b = gca_shrink(b, &bsize, sizeof(int), 3, p);
+  TASSERT(bsize == 8 && b == x);
+  b = gca_capacity(b, &bsize, sizeof(int), 4096);
+  for(i = 8; i < 4096 && b[i] == 0; i++) {}
+  TASSERT(i == 4096);
+  b = gca_shrink_to(b, &bsize, sizeof(int), 0, false);
+  TASSERT(bsize == 1);
+  free(b);
+}
+
+void test_circbuf_fd()
+{
+  status("Testing circular array file I/O...");
+
+  CircBuf src, dst;
+  int fds[2];
+  size_t i, t, nsent = 0, nrecv = 0, nerr = 0;
+  ssize_t r;
+  char c;
+
+  if(pipe(fds) != 0) { status("  pipe() failed, skipping"); return; }
+
+  // t == 0: heap buffers, t == 1: mirrored destination
+  for(t = 0; t < 2; t++) {
+    circa_alloc(&src, 1, 64);
+    if(t == 0 || !circa_alloc_mirror(&dst, 1, 64)) circa_alloc(&dst, 1, 64);
+    src.nozero = dst.nozero = true;
+    src.start = 50; // both buffers wrap
+    dst.start = dst.size - 10;
+
+    for(i = 0; i < 200; i++) {
+      // top up the source, send some, receive some
+      while(src.n < 60) *(char*)circa_unshift(&src) = (char)(nsent + src.n);
+      r = circa_writev_fd(&src, fds[1], 1 + i % 60);
+      TASSERT(r == (ssize_t)(1 + i % 60));
+      nsent += r;
+      r = circa_readv_fd(&dst, fds[0], 1 + (i*7) % 60);
+      TASSERT(r > 0);
+      // check and discard what we received
+      while(dst.n > 20) {
+        c = *(char*)circa_pop(&dst);
+        nerr += (c != (char)nrecv++);
+      }
+    }
+    TASSERT(src.size == 64);
+    // drain the pipe
+    while(nrecv + dst.n < nsent && circa_readv_fd(&dst, fds[0], 100) > 0) {}
+    while(dst.n) nerr += (*(char*)circa_pop(&dst) != (char)nrecv++);
+    TASSERT(nrecv == nsent);
+    circa_dealloc(&src);
+    circa_dealloc(&dst);
+  }
+  TASSERT(nerr == 0);
+
+  // errors are returned as from readv() / writev()
+  circa_alloc(&dst, 1, 8);
+  close(fds[1]);
+  TASSERT(circa_readv_fd(&dst, fds[0], 8) == 0 && dst.n == 0); // EOF
+  close(fds[0]);
+  TASSERT(circa_readv_fd(&dst, fds[0], 8) == -1 && dst.n == 0);
+  circa_dealloc(&dst);
+}
+
+void test_circ_deque()
+{
+  status("Testing segmented circular array...");
+
+  CircDeque d;
+  CircBuf l; // reference
+  int i, v, *ptr, *first = NULL, firstv = 0;
+  size_t j, nerr = 0;
+
+  circa_deque_alloc(&d, sizeof(int), 5);
+  circa_alloc(&l, sizeof(int), 8);
+  TASSERT(d.bsize == 8);
+
+  for(i = 0; i < 20000; i++) {
+    // grow more often than shrink for the first half
+    switch(lrand48() % (i < 10000 ? 6 : 4)) {
+      case 0: case 4:
+        *(int*)circa_deque_push(&d) = *(int*)circa_push(&l) = i;
+        break;
+      case 1: case 5:
+        *(int*)circa_deque_unshift(&d) = *(int*)circa_unshift(&l) = i;
+        break;
+      case 2:
+        if(!l.n) break;
+        ptr = circa_deque_pop(&d);
+        nerr += (*ptr != *(int*)circa_pop(&l));
+        if(ptr == first) first = NULL;
+        break;
+      case 3:
+        if(!l.n) break;
+        ptr = circa_deque_shift(&d);
+        nerr += (*ptr != *(int*)circa_shift(&l));
+        if(ptr == first) first = NULL;
+        break;
+    }
+    TASSERT(d.n == l.n);
+    // element addresses don't change while other elements are added/removed
+    if(first) nerr += (*first != firstv);
+    if(d.n && i % 100 == 0) { first = circa_deque_get(&d, d.n/2); firstv = *first; }
+  }
+  for(j = 0; j < l.n; j++)
+    nerr += (*(int*)circa_deque_get(&d, j) != *(int*)circa_get(&l, j));
+  TASSERT(nerr == 0);
+
+  // drain
+  while(d.n) {
+    v = *(int*)circa_deque_pop(&d);
+    TASSERT(v == *(int*)circa_pop(&l));
+  }
+  TASSERT(d.blocks.n == 0);
+  TASSERT(*(int*)circa_deque_unshift(&d) == 0);
+
+  circa_deque_dealloc(&d);
+  circa_dealloc(&l);
+}
+
+#define MQ_NTHREADS 4
+#define MQ_NPERTHREAD 5000
+
+typedef struct {
+  GcaMQueue *mq;
+  size_t tid, npopped;
+  uint32_t *popped;
+} MQTestThread;
+
+static void* mq_test_thread(void *ptr)
+{
+  MQTestThread *t = (MQTestThread*)ptr;
+  uint32_t i, v;
+  // push distinct values, popping every other push
+  for(i = 0; i < MQ_NPERTHREAD; i++) {
+    v = t->tid * MQ_NPERTHREAD + i;
+    gca_mq_push(t->mq, &v);
+    if((i & 1) && gca_mq_pop(t->mq, &v)) t->popped[t->npopped++] = v;
+  }
+  return NULL;
+}
+
+void test_circ_window()
+{
+  status("Testing sliding window aggregates...");
+
+  #define W 50
+  CircBuf l; // reference window
+  CircMinMax mm;
+  CircSum sum;
+  CircQuant med, q90;
+  int i, v, sorted[4*W], *mn, *mx;
+  size_t j, k, nerr = 0;
+  double tot;
+
+  circa_alloc(&l, sizeof(int), W);
+  circa_minmax_alloc(&mm, sizeof(int), gca_cmp2_int, NULL);
+  circa_sum_alloc(&sum, W);
+  circa_quant_alloc(&med, sizeof(int), 0.5, gca_cmp2_int, NULL);
+  circa_quant_alloc(&q90, sizeof(int), 0.9, gca_cmp2_int, NULL);
+
+  for(i = 0; i < 20000; i++) {
+    // window mostly grows for 1000 steps then mostly shrinks, up to 4*W
+    if(l.n == 0 || (l.n < 4*W && (rand() % 3 == 0) == ((i/1000) % 2))) {
+      v = rand() % 100 - 50; // lots of duplicates
+      *(int*)circa_unshift(&l) = v;
+      circa_minmax_unshift(&mm, &v);
+      circa_sum_unshift(&sum, v);
+      circa_quant_unshift(&med, &v);
+      circa_quant_unshift(&q90, &v);
+    } else {
+      v = *(int*)circa_pop(&l);
+      circa_minmax_pop(&mm);
+      nerr += (circa_sum_pop(&sum) != v);
+      circa_quant_pop(&med);
+      circa_quant_pop(&q90);
+    }
+    TASSERT(mm.n == l.n && circa_sum_n(&sum) == l.n && circa_quant_n(&med) == l.n);
+    if(!l.n) { nerr += (circa_sum_total(&sum) != 0); continue; }
+
+    for(j = 0, tot = 0; j < l.n; j++) sorted[j] = *(int*)circa_get(&l, j), tot += sorted[j];
+    mn = gca_min(sorted, l.n, sizeof(int), gca_cmp2_int, NULL);
+    mx = gca_max(sorted, l.n, sizeof(int), gca_cmp2_int, NULL);
+    nerr += (*(int*)circa_minmax_min(&mm) != *mn);
+    nerr += (*(int*)circa_minmax_max(&mm) != *mx);
+    nerr += (circa_sum_total(&sum) != tot);
+    nerr += (circa_sum_mean(&sum) != tot / l.n);
+    gca_qsort(sorted, l.n, sizeof(int), gca_cmp2_int, NULL);
+    nerr += (*(int*)circa_quant_get(&med) != sorted[(l.n-1)/2]);
+    k = (size_t)(0.9 * (l.n-1));
+    nerr += (*(int*)circa_quant_get(&q90) != sorted[k]);
+  }
+  TASSERT(nerr == 0);
+
+  // sum does not drift when large and small values pass through the window
+  circa_sum_unshift(&sum, 0.1);
+  for(i = 0; i < 1000; i++) {
+    circa_sum_unshift(&sum, (i & 1) ? 1e16 : 1);
+    if(circa_sum_n(&sum) > 3) circa_sum_pop(&sum);
+  }
+  while(circa_sum_n(&sum) > 1) circa_sum_pop(&sum);
+  TASSERT(circa_sum_total(&sum) == 1e16);
+
+  circa_dealloc(&l);
+  circa_minmax_dealloc(&mm);
+  circa_sum_dealloc(&sum);
+  circa_quant_dealloc(&med);
+  circa_quant_dealloc(&q90);
+  #undef W
+}
+
+void test_multiqueue()
+{
+  status("Testing concurrent priority queue...");
+
+  const size_t nvals = MQ_NTHREADS * MQ_NPERTHREAD;
+  GcaMQueue mq;
+  MQTestThread threads[MQ_NTHREADS];
+  pthread_t pths[MQ_NTHREADS];
+  uint32_t *popped = malloc(nvals * sizeof(uint32_t)), v, prev;
+  uint8_t *seen = calloc(nvals, 1);
+  size_t i, n, npopped = 0, strict;
+
+  for(strict = 0; strict < 2; strict++)
+  {
+    gca_mq_alloc(&mq, sizeof(uint32_t), 8, strict, gca_cmp2_uint32, NULL);
+    memset(seen, 0, nvals);
+
+    for(i = 0; i < MQ_NTHREADS; i++) {
+      threads[i] = (MQTestThread){.mq = &mq, .tid = i, .npopped = 0,
+                                  .popped = popped + i*MQ_NPERTHREAD};
+      pthread_create(&pths[i], NULL, mq_test_thread, &threads[i]);
+    }
+    for(i = 0, npopped = 0; i < MQ_NTHREADS; i++) {
+      pthread_join(pths[i], NULL);
+      for(n = 0; n < threads[i].npopped; n++) seen[threads[i].popped[n]]++;
+      npopped += threads[i].npopped;
+    }
+    TASSERT(gca_mq_size(&mq) == nvals - npopped);
+
+    // drain the queue, strict mode must return elements in order
+    for(prev = UINT32_MAX; gca_mq_pop(&mq, &v); prev = v) {
+      TASSERT(v < nvals);
+      if(v < nvals) seen[v]++;
+      if(strict) TASSERT(v < prev);
+    }
+    TASSERT(gca_mq_size(&mq) == 0);
+
+    // every value was popped exactly once
+    for(i = 0; i < nvals && seen[i] == 1; i++) {}
+    TASSERT(i == nvals);
+
+    gca_mq_dealloc(&mq);
+  }
+
+  free(seen);
+  free(popped);
+}
+
+#define SPSC_NVALS 200000
+
+// Producer: push 0..SPSC_NVALS-1 using single, batch and reserve/commit calls
+static void* spsc_test_producer(void *ptr)
+{
+  CircSPSC *q = (CircSPSC*)ptr;
+  uint32_t i, j, buf[10], *slots;
+  size_t n;
+  for(i = 0; i < SPSC_NVALS; i += n) {
+    n = SPSC_NVALS-i < 10 ? SPSC_NVALS-i : 10;
+    switch(i % 3) {
+      case 0:
+        n = circa_spsc_push(q, &i);
+        break;
+      case 1:
+        for(j = 0; j < n; j++) buf[j] = i+j;
+        n = circa_spsc_push_n(q, buf, n);
+        break;
+      case 2:
+        slots = circa_spsc_reserve(q, &n);
+        for(j = 0; j < n; j++) slots[j] = i+j;
+        circa_spsc_commit(q, n);
+        break;
+    }
+    if(!n) sched_yield(); // full, let the consumer run
+  }
+  return NULL;
+}
+
+void test_spsc()
+{
+  status("Testing single-producer/single-consumer circular array...");
+
+  CircSPSC q;
+  pthread_t producer;
+  uint32_t i, j, v, buf[13], *elems;
+  size_t n, nerr = 0;
+
+  circa_spsc_alloc(&q, sizeof(uint32_t), 60);
+  TASSERT(q.size == 64);
+  TASSERT(!circa_spsc_pop(&q, &v));
+
+  pthread_create(&producer, NULL, spsc_test_producer, &q);
+
+  for(i = 0; i < SPSC_NVALS; i += n) {
+    switch(i % 3) {
+      case 0:
+        n = circa_spsc_pop(&q, &v);
+        if(n) nerr += (v != i);
+        break;
+      case 1:
+        n = circa_spsc_pop_n(&q, buf, 13);
+        for(j = 0; j < n; j++) nerr += (buf[j] != i+j);
+        break;
+      case 2:
+        n = 5;
+        elems = circa_spsc_peek(&q, &n);
+        for(j = 0; j < n; j++) nerr += (elems[j] != i+j);
+        circa_spsc_release(&q, n);
+        break;
+    }
+    if(!n) sched_yield(); // empty, let the producer run
+  }
+
+  pthread_join(producer, NULL);
+  TASSERT(nerr == 0);
+  TASSERT(i == SPSC_NVALS);
+  TASSERT(!circa_spsc_pop(&q, &v));
+
+  // fill to capacity
+  for(i = 0; circa_spsc_push(&q, &i); i++) {}
+  TASSERT(i == 64);
+  n = 10;
+  circa_spsc_reserve(&q, &n);
+  TASSERT(n == 0);
+  for(i = 0; circa_spsc_pop(&q, &v); i++) TASSERT(v == i);
+  TASSERT(i == 64);
+
+  circa_spsc_dealloc(&q);
+}
+
+#define MPMC_NPRODUCERS 3
+#define MPMC_NCONSUMERS 3
+#define MPMC_NPERTHREAD 20000
+#define MPMC_END UINT32_MAX
+
+typedef struct {
+  CircMPMC *q;
+  size_t tid, n;
+  uint8_t *seen; // consumers: count of each value popped
+} MPMCTestThread;
+
+static void* mpmc_test_producer(void *ptr)
+{
+  MPMCTestThread *t = (MPMCTestThread*)ptr;
+  uint32_t i, j, n, buf[8], v = t->tid * MPMC_NPERTHREAD;
+  for(i = 0; i < MPMC_NPERTHREAD; i += n, v += n) {
+    n = MPMC_NPERTHREAD - i < 8 ? MPMC_NPERTHREAD - i : 8;
+    for(j = 0; j < n; j++) buf[j] = v+j;
+    switch(t->n++ % 4) {
+      case 0: circa_mpmc_push(t->q, buf); n = 1; break;
+      case 1: n = circa_mpmc_trypush(t->q, buf); break;
+      case 2: circa_mpmc_push_n(t->q, buf, n); break;
+      case 3: n = circa_mpmc_trypush_n(t->q, buf, n < 3 ? n : 3); break;
+    }
+  }
+  return NULL;
+}
+
+static void* mpmc_test_consumer(void *ptr)
+{
+  MPMCTestThread *t = (MPMCTestThread*)ptr;
+  uint32_t buf[5];
+  size_t i, n;
+  while(1) {
+    n = t->n++ & 1 ? circa_mpmc_pop_n(t->q, buf, 5)
+                   : (circa_mpmc_pop(t->q, buf), 1);
+    for(i = 0; i < n; i++) {
+      if(buf[i] == MPMC_END) {
+        // give back other consumers' end markers
+        if(i+1 < n) circa_mpmc_push_n(t->q, buf+i+1, n-i-1);
+        return NULL;
+      }
+      __atomic_fetch_add(&t->seen[buf[i]], 1, __ATOMIC_RELAXED);
+    }
+  }
+}
+
+void test_mpmc()
+{
+  status("Testing multi-producer/multi-consumer circular array...");
+
+  const size_t nvals = MPMC_NPRODUCERS * MPMC_NPERTHREAD;
+  CircMPMC q;
+  MPMCTestThread prod[MPMC_NPRODUCERS], cons[MPMC_NCONSUMERS];
+  pthread_t prodth[MPMC_NPRODUCERS], consth[MPMC_NCONSUMERS];
+  uint8_t *seen = calloc(nvals, 1);
+  uint32_t v, w, end = MPMC_END;
+  size_t i, futex;
+
+  for(futex = 0; futex < 2; futex++)
+  {
+    circa_mpmc_alloc(&q, sizeof(uint32_t), 16, futex);
+    memset(seen, 0, nvals);
+    TASSERT(!circa_mpmc_trypop(&q, &v));
+
+    for(i = 0; i < MPMC_NCONSUMERS; i++) {
+      cons[i] = (MPMCTestThread){.q = &q, .tid = i, .n = 0, .seen = seen};
+      pthread_create(&consth[i], NULL, mpmc_test_consumer, &cons[i]);
+    }
+    for(i = 0; i < MPMC_NPRODUCERS; i++) {
+      prod[i] = (MPMCTestThread){.q = &q, .tid = i, .n = 0, .seen = NULL};
+      pthread_create(&prodth[i], NULL, mpmc_test_producer, &prod[i]);
+    }
+    for(i = 0; i < MPMC_NPRODUCERS; i++) pthread_join(prodth[i], NULL);
+    // one end marker per consumer
+    for(i = 0; i < MPMC_NCONSUMERS; i++) circa_mpmc_push(&q, &end);
+    for(i = 0; i < MPMC_NCONSUMERS; i++) pthread_join(consth[i], NULL);
+
+    for(i = 0; i < nvals && seen[i] == 1; i++) {}
+    TASSERT(i == nvals);
+
+    // fill to capacity then drain
+    for(v = 0; circa_mpmc_trypush(&q, &v); v++) {}
+    TASSERT(v == 16);
+    for(v = 0; circa_mpmc_trypop(&q, &w) && w == v; v++) {}
+    TASSERT(v == 16);
+
+    circa_mpmc_dealloc(&q);
+  }
+
+  free(seen);
+}
 
 #define arrset5(x,a,b,c,d,e) do { x[0]=(a);x[1]=(b);x[2]=(c);x[3]=(d);x[4]=(e); }while(0)
 
@@ -419,6 +1781,308 @@ void test_median()
   #undef N
 }
 
+// Check gca_select_ro / gca_select2_ro against a sorted copy, and that the
+// input is not changed
+static void check_select_ro(const uint32_t *arr, size_t n, const size_t *ks,
+                            size_t nks)
+{
+  uint32_t *sorted = malloc(n * sizeof(uint32_t)), out[2];
+  size_t i, k, h0 = 0, h1 = 0;
+  memcpy(sorted, arr, n * sizeof(uint32_t));
+  qsort(sorted, n, sizeof(uint32_t), gca_cmp_uint32);
+  for(i = 0; i < n; i++) h0 = h0*31 + arr[i];
+  for(i = 0; i < nks; i++) {
+    k = ks[i];
+    gca_select_ro(arr, n, sizeof(uint32_t), k, gca_cmp2_uint32, NULL, out);
+    TASSERT(out[0] == sorted[k]);
+    if(k+1 < n) {
+      gca_select2_ro(arr, n, sizeof(uint32_t), k, gca_cmp2_uint32, NULL, out);
+      TASSERT(out[0] == sorted[k] && out[1] == sorted[k+1]);
+    }
+  }
+  for(i = 0; i < n; i++) h1 = h1*31 + arr[i];
+  TASSERT(h0 == h1);
+  free(sorted);
+}
+
+void test_select_ro()
+{
+  status("Testing read-only selection...");
+
+  size_t i, j, n, ks[50];
+  uint32_t *arr = malloc(300000 * sizeof(uint32_t));
+  GcaRand r;
+  gca_rand_seed(&r, 21);
+
+  // small arrays are copied, try every rank
+  for(n = 1; n <= 50; n++) {
+    for(i = 0; i < n; i++) { arr[i] = gca_rand_bounded(&r, 5); ks[i] = i; }
+    check_select_ro(arr, n, ks, n);
+  }
+
+  // big arrays are narrowed in passes: distinct values, few values, one
+  // value, sorted and reverse sorted
+  n = 300000;
+  for(j = 0; j < 5; j++) {
+    for(i = 0; i < n; i++) {
+      switch(j) {
+        case 0: arr[i] = gca_rand_next(&r); break;
+        case 1: arr[i] = gca_rand_bounded(&r, 3); break;
+        case 2: arr[i] = 7; break;
+        case 3: arr[i] = i; break;
+        case 4: arr[i] = n-i; break;
+      }
+    }
+    ks[0] = 0; ks[1] = 1; ks[2] = n/2-1; ks[3] = n/2; ks[4] = n-2; ks[5] = n-1;
+    for(i = 6; i < 12; i++) ks[i] = gca_rand_bounded(&r, n);
+    check_select_ro(arr, n, ks, 12);
+  }
+
+  // medians
+  double d[] = {3, 1, 2, 5}, *dd = malloc(n * sizeof(double));
+  TASSERT(gca_median_ro_double(d, 0) == 0);
+  TASSERT(gca_median_ro_double(d, 3) == 2);
+  TASSERT(gca_median_ro_double(d, 4) == 2.5);
+  TASSERT(d[0] == 3 && d[1] == 1 && d[2] == 2 && d[3] == 5);
+  for(i = 0; i < n; i++) dd[i] = gca_rand_double(&r);
+  double m = gca_median_ro_double(dd, n - 1);
+  TASSERT(m == gca_median_double(dd, n - 1));
+  m = gca_median_ro_double(dd, n);
+  TASSERT(m == gca_median_double(dd, n));
+  int ints[] = {4, 9, 1, 6};
+  TASSERT(gca_median_ro_int(ints, 4) == 5);
+
+  free(dd);
+  free(arr);
+}
+
+// Build expected multiset intersection / union / difference of sorted a and b
+// from value counts. Values are < 16
+static size_t set_op_expected(const int *a, size_t na, const int *b, size_t nb,
+                              int op, int *out)
+{
+  size_t ca[16] = {0}, cb[16] = {0}, i, c, n = 0;
+  int v;
+  for(i = 0; i < na; i++) ca[a[i]]++;
+  for(i = 0; i < nb; i++) cb[b[i]]++;
+  for(v = 0; v < 16; v++) {
+    if(op == 0) c = ca[v] < cb[v] ? ca[v] : cb[v];
+    else if(op == 1) c = ca[v] > cb[v] ? ca[v] : cb[v];
+    else c = ca[v] > cb[v] ? ca[v] - cb[v] : 0;
+    for(i = 0; i < c; i++) out[n++] = v;
+  }
+  return n;
+}
+
+static void check_set_ops(const int *a, size_t na, const int *b, size_t nb)
+{
+  int exp[1000], out[1000], tmp[1000];
+  size_t n, m;
+
+  n = set_op_expected(a, na, b, nb, 0, exp);
+  m = gca_set_intersect(a, na, b, nb, sizeof(int), gca_cmp2_int, NULL, out);
+  TASSERT(m == n && memcmp(out, exp, n*sizeof(int)) == 0);
+  TASSERT(gca_set_count_intersect(a, na, b, nb, sizeof(int), gca_cmp2_int, NULL) == n);
+  // in place
+  memcpy(tmp, a, na*sizeof(int));
+  m = gca_set_intersect(tmp, na, b, nb, sizeof(int), gca_cmp2_int, NULL, tmp);
+  TASSERT(m == n && memcmp(tmp, exp, n*sizeof(int)) == 0);
+
+  n = set_op_expected(a, na, b, nb, 1, exp);
+  m = gca_set_union(a, na, b, nb, sizeof(int), gca_cmp2_int, NULL, out);
+  TASSERT(m == n && memcmp(out, exp, n*sizeof(int)) == 0);
+
+  n = set_op_expected(a, na, b, nb, 2, exp);
+  m = gca_set_diff(a, na, b, nb, sizeof(int), gca_cmp2_int, NULL, out);
+  TASSERT(m == n && memcmp(out, exp, n*sizeof(int)) == 0);
+  memcpy(tmp, a, na*sizeof(int));
+  m = gca_set_diff(tmp, na, b, nb, sizeof(int), gca_cmp2_int, NULL, tmp);
+  TASSERT(m == n && memcmp(tmp, exp, n*sizeof(int)) == 0);
+}
+
+void test_set_ops()
+{
+  status("Testing sorted set operations...");
+
+  int a[500], b[500], u[10] = {1, 1, 1, 2, 3, 3, 7, 8, 8, 8};
+  size_t i, t, na, nb;
+  GcaRand r;
+  gca_rand_seed(&r, 49);
+
+  TASSERT(gca_unique(u, 0, sizeof(int), gca_cmp2_int, NULL) == 0);
+  TASSERT(gca_unique(u, 1, sizeof(int), gca_cmp2_int, NULL) == 1);
+  TASSERT(gca_unique(u, 10, sizeof(int), gca_cmp2_int, NULL) == 5);
+  TASSERT(u[0] == 1 && u[1] == 2 && u[2] == 3 && u[3] == 7 && u[4] == 8);
+
+  // similar sizes (merge) and very different sizes (galloping), with
+  // duplicates
+  for(t = 0; t < 2000; t++) {
+    na = gca_rand_bounded(&r, t < 1000 ? 30 : 3);
+    nb = gca_rand_bounded(&r, t < 1000 ? 30 : 500);
+    for(i = 0; i < na; i++) a[i] = gca_rand_bounded(&r, 16);
+    for(i = 0; i < nb; i++) b[i] = gca_rand_bounded(&r, 16);
+    qsort(a, na, sizeof(int), gca_cmp_int);
+    qsort(b, nb, sizeof(int), gca_cmp_int);
+    check_set_ops(a, na, b, nb);
+    check_set_ops(b, nb, a, na);
+  }
+
+  // typed intersection of sets matches the generic one
+  #define N 5000
+  uint32_t *a32 = malloc(N*sizeof(uint32_t)), *b32 = malloc(N*sizeof(uint32_t));
+  uint32_t *o32 = malloc(N*sizeof(uint32_t)), *e32 = malloc(N*sizeof(uint32_t));
+  uint64_t *a64 = malloc(N*sizeof(uint64_t)), *b64 = malloc(N*sizeof(uint64_t));
+  uint64_t *o64 = malloc(N*sizeof(uint64_t)), *e64 = malloc(N*sizeof(uint64_t));
+  size_t m, n, range;
+  for(t = 0; t < 200; t++) {
+    // dense or sparse, similar or skewed sizes
+    range = t % 2 ? 2*N : 100*N;
+    na = gca_rand_bounded(&r, N);
+    nb = t % 4 < 2 ? gca_rand_bounded(&r, N) : gca_rand_bounded(&r, 50);
+    gca_sample_idx((size_t*)a64, range, na, &r);
+    gca_sample_idx((size_t*)b64, range, nb, &r);
+    qsort(a64, na, sizeof(uint64_t), gca_cmp_uint64);
+    qsort(b64, nb, sizeof(uint64_t), gca_cmp_uint64);
+    for(i = 0; i < na; i++) { a32[i] = a64[i]; a64[i] += 1ULL<<40; }
+    for(i = 0; i < nb; i++) { b32[i] = b64[i]; b64[i] += 1ULL<<40; }
+
+    n = gca_set_intersect(a32, na, b32, nb, sizeof(uint32_t), gca_cmp2_uint32, NULL, e32);
+    m = gca_set_intersect_uint32(a32, na, b32, nb, o32);
+    TASSERT(m == n && memcmp(o32, e32, n*sizeof(uint32_t)) == 0);
+    TASSERT(gca_set_count_intersect_uint32(b32, nb, a32, na) == n);
+    // in place
+    m = gca_set_intersect_uint32(a32, na, b32, nb, a32);
+    TASSERT(m == n && memcmp(a32, e32, n*sizeof(uint32_t)) == 0);
+
+    n = gca_set_intersect(a64, na, b64, nb, sizeof(uint64_t), gca_cmp2_uint64, NULL, e64);
+    m = gca_set_intersect_uint64(a64, na, b64, nb, o64);
+    TASSERT(m == n && memcmp(o64, e64, n*sizeof(uint64_t)) == 0);
+    TASSERT(gca_set_count_intersect_uint64(b64, nb, a64, na) == n);
+    // in place
+    m = gca_set_intersect_uint64(a64, na, b64, nb, a64);
+    TASSERT(m == n && memcmp(a64, e64, n*sizeof(uint64_t)) == 0);
+  }
+
+  // in place, stopping the vector loop while a's block is still current
+  uint32_t sa32[4] = {10, 20, 30, 40}, sb32[5] = {20, 21, 22, 23, 30};
+  uint64_t sa64[4] = {10, 20, 30, 40}, sb64[5] = {20, 21, 22, 23, 30};
+  TASSERT(gca_set_intersect_uint32(sa32, 4, sb32, 5, o32) == 2);
+  TASSERT(o32[0] == 20 && o32[1] == 30);
+  TASSERT(gca_set_intersect_uint32(sa32, 4, sb32, 5, sa32) == 2);
+  TASSERT(sa32[0] == 20 && sa32[1] == 30);
+  TASSERT(gca_set_intersect_uint64(sa64, 4, sb64, 5, o64) == 2);
+  TASSERT(o64[0] == 20 && o64[1] == 30);
+  TASSERT(gca_set_intersect_uint64(sa64, 4, sb64, 5, sa64) == 2);
+  TASSERT(sa64[0] == 20 && sa64[1] == 30);
+
+  free(a32); free(b32); free(o32); free(e32);
+  free(a64); free(b64); free(o64); free(e64);
+  #undef N
+}
+
+// Element of a run: sorted by key, run and idx record where it came from
+typedef struct { int key; uint32_t run, idx; } MergeEl;
+
+static int merge_el_cmp(const void *a, const void *b, void *arg)
+{
+  (void)arg;
+  return gca_cmp(((const MergeEl*)a)->key, ((const MergeEl*)b)->key);
+}
+
+// Hand out each run in blocks of 1-7 elements, copied into a buffer that is
+// overwritten by the next call for that run
+typedef struct {
+  MergeEl **runs, bufs[100][7];
+  size_t *lens, pos[100];
+  GcaRand r;
+} MergeSrc;
+
+static size_t merge_fill(size_t run, const void **block, void *arg)
+{
+  MergeSrc *src = (MergeSrc*)arg;
+  size_t n = 1 + gca_rand_bounded(&src->r, 7), left = src->lens[run] - src->pos[run];
+  if(n > left) n = left;
+  memcpy(src->bufs[run], src->runs[run] + src->pos[run], n * sizeof(MergeEl));
+  src->pos[run] += n;
+  *block = src->bufs[run];
+  return n;
+}
+
+// Output has every element once, in key order and stable
+static bool check_merged(const MergeEl *out, size_t n, size_t total)
+{
+  size_t i;
+  if(n != total) return false;
+  for(i = 1; i < n; i++) {
+    if(out[i-1].key > out[i].key) return false;
+    if(out[i-1].key == out[i].key &&
+       (out[i-1].run > out[i].run ||
+        (out[i-1].run == out[i].run && out[i-1].idx >= out[i].idx)))
+      return false;
+  }
+  return true;
+}
+
+void test_merge_k()
+{
+  status("Testing k-way merge...");
+
+  size_t ks[] = {0, 1, 2, 3, 5, 16, 100};
+  MergeEl *runs[100], *out = malloc(5000 * sizeof(MergeEl));
+  const MergeEl *e;
+  size_t lens[100], t, i, j, k, n, total;
+  MergeSrc src;
+  GcaMergeK m;
+  GcaRand r;
+  gca_rand_seed(&r, 50);
+  gca_rand_seed(&src.r, 51);
+  src.runs = runs;
+  src.lens = lens;
+
+  for(t = 0; t < sizeof(ks)/sizeof(ks[0]); t++) {
+    k = ks[t];
+    for(i = total = 0; i < k; i++) {
+      // some empty runs, few distinct keys so there are many ties
+      lens[i] = gca_rand_bounded(&r, 4) ? gca_rand_bounded(&r, 50) : 0;
+      runs[i] = malloc((lens[i] + 1) * sizeof(MergeEl));
+      for(j = 0; j < lens[i]; j++)
+        runs[i][j] = (MergeEl){.key = gca_rand_bounded(&r, 20), .run = i, .idx = j};
+      gca_qsort(runs[i], lens[i], sizeof(MergeEl), merge_el_cmp, NULL);
+      for(j = 0; j < lens[i]; j++) runs[i][j].idx = j;
+      total += lens[i];
+    }
+
+    memset(out, 0, 5000 * sizeof(MergeEl));
+    TASSERT(gca_merge_k((const void *const*)runs, lens, k, sizeof(MergeEl),
+                        out, merge_el_cmp, NULL));
+    TASSERT(check_merged(out, total, total));
+
+    // streaming, one element at a time
+    memset(src.pos, 0, sizeof(src.pos));
+    TASSERT(gca_mergek_alloc(&m, k, sizeof(MergeEl), merge_el_cmp, NULL,
+                             merge_fill, &src));
+    for(n = 0; (e = gca_mergek_next(&m)) != NULL; n++) out[n] = *e;
+    TASSERT(gca_mergek_next(&m) == NULL);
+    gca_mergek_dealloc(&m);
+    TASSERT(check_merged(out, n, total));
+
+    // streaming, in chunks, mixed with next()
+    memset(src.pos, 0, sizeof(src.pos));
+    TASSERT(gca_mergek_alloc(&m, k, sizeof(MergeEl), merge_el_cmp, NULL,
+                             merge_fill, &src));
+    for(n = 0; (e = gca_mergek_next(&m)) != NULL; ) {
+      out[n++] = *e;
+      n += gca_mergek_read(&m, out+n, 13);
+    }
+    TASSERT(gca_mergek_read(&m, out+n, 13) == 0);
+    gca_mergek_dealloc(&m);
+    TASSERT(check_merged(out, n, total));
+
+    for(i = 0; i < k; i++) free(runs[i]);
+  }
+  free(out);
+}
+
 
 void check_permutation5(size_t **pp, size_t a, size_t b, size_t c, size_t d, size_t e,
                         size_t *init)
@@ -492,6 +2156,184 @@ void test_next_perm_with_dupes()
   free(p);
 }
 
+// Rank and unrank every permutation of init, in gca_itr_next() order
+static void check_perm_ranks(size_t *init, size_t n)
+{
+  size_t *p = NULL, *q = NULL, *sorted = NULL, q2[8], i;
+  uint64_t k, rank, total = gca_perm_count(init, n);
+
+  if(init) {
+    sorted = malloc(n * sizeof(size_t));
+    memcpy(sorted, init, n * sizeof(size_t));
+    qsort(sorted, n, sizeof(size_t), gca_cmp_size);
+  }
+  for(k = 0; gca_itr_next(&p, n, sorted); k++) {
+    TASSERT(gca_perm_rank(p, n) == k);
+    TASSERT(gca_perm_unrank(q2, n, k, init) == q2);
+    for(i = 0; i < n && q2[i] == p[i]; i++) {}
+    TASSERT(i == n);
+  }
+  TASSERT(k == total);
+  TASSERT(gca_perm_unrank(q2, n, total, init) == NULL);
+
+  // ranges [0,k), [k,2k) ... cover the same permutations in the same order
+  gca_itr_reset(p, n);
+  for(k = 0; k < total; k += 7) {
+    rank = k;
+    q = gca_itr_reset(q, n);
+    while(gca_itr_range(&q, n, init, &rank, k+7)) {
+      TASSERT(gca_itr_next(&p, n, sorted) != NULL);
+      for(i = 0; i < n && q[i] == p[i]; i++) {}
+      TASSERT(i == n);
+    }
+    TASSERT(rank == (k+7 < total ? k+7 : total));
+  }
+  TASSERT(gca_itr_next(&p, n, sorted) == NULL);
+
+  free(p);
+  free(q);
+  free(sorted);
+}
+
+void test_perm_rank()
+{
+  status("Testing permutation rank / unrank...");
+
+  size_t p[21], *q = NULL, i, dupes[] = {3, 1, 2, 3, 1, 3}, ones[] = {1, 1, 1};
+  uint64_t fact = 1, rank;
+
+  check_perm_ranks(NULL, 1);
+  check_perm_ranks(NULL, 5);
+  check_perm_ranks(dupes, 6);
+  check_perm_ranks(ones, 3);
+
+  TASSERT(gca_perm_count(NULL, 0) == 1);
+  TASSERT(gca_perm_count(dupes, 6) == 60);
+  for(i = 1; i <= 20; i++) fact *= i;
+  TASSERT(gca_perm_count(NULL, 20) == fact);
+  TASSERT(gca_perm_count(NULL, 21) == UINT64_MAX);
+
+  // last permutation of 20 values is 19,18,...,0
+  TASSERT(gca_perm_unrank(p, 20, fact-1, NULL) == p);
+  for(i = 0; i < 20 && p[i] == 19-i; i++) {}
+  TASSERT(i == 20);
+  TASSERT(gca_perm_rank(p, 20) == fact-1);
+  TASSERT(gca_perm_unrank(p, 20, fact, NULL) == NULL);
+  gca_perm_unrank(p, 20, 123456789012345ULL, NULL);
+  TASSERT(gca_perm_rank(p, 20) == 123456789012345ULL);
+
+  // 21 distinct values have too many permutations to rank
+  for(i = 0; i < 21; i++) p[i] = i;
+  SWAP(p[19], p[20]);
+  TASSERT(gca_perm_rank(p, 21) == UINT64_MAX);
+  TASSERT(gca_perm_unrank(p, 21, fact, NULL) == NULL);
+  rank = fact;
+  TASSERT(gca_itr_range(&q, 21, NULL, &rank, fact+1) == NULL);
+  TASSERT(rank == fact);
+  free(q);
+}
+
+// Check a generator visits every permutation of n <= 6 values once, changing
+// two elements each step (adjacent ones if adjacent is true)
+static void check_swap_perms(void* (*itr)(size_t**, void*, size_t, size_t),
+                             size_t n, bool adjacent)
+{
+  size_t *state = NULL, arr[6], prev[6], i, ndiff, first, last, count = 0;
+  bool seen[720] = {false};
+  uint64_t rank;
+  for(i = 0; i < n; i++) arr[i] = i;
+
+  while(itr(&state, arr, n, sizeof(arr[0]))) {
+    rank = gca_perm_rank(arr, n);
+    TASSERT(rank < 720 && !seen[rank < 720 ? rank : 0]);
+    seen[rank < 720 ? rank : 0] = true;
+    if(count++) {
+      for(i = ndiff = first = last = 0; i < n; i++)
+        if(arr[i] != prev[i]) { if(!ndiff++) first = i; last = i; }
+      TASSERT(ndiff == 2);
+      if(adjacent) TASSERT(last == first+1);
+    }
+    memcpy(prev, arr, sizeof(arr));
+  }
+  TASSERT(count == gca_perm_count(NULL, n));
+  TASSERT(itr(&state, arr, n, sizeof(arr[0])) == NULL);
+
+  // reset and go again
+  gca_itr_reset(state, n);
+  for(count = 0; itr(&state, arr, n, sizeof(arr[0])); count++) {}
+  TASSERT(count == gca_perm_count(NULL, n));
+  free(state);
+}
+
+void test_swap_perms()
+{
+  status("Testing Heap's / plain changes permutations...");
+
+  size_t n, *state = NULL;
+  for(n = 1; n <= 6; n++) {
+    check_swap_perms(gca_itr_heap, n, false);
+    check_swap_perms(gca_itr_sjt, n, true);
+  }
+  TASSERT(gca_itr_heap(&state, NULL, 0, 1) == NULL);
+  TASSERT(gca_itr_sjt(&state, NULL, 0, 1) == NULL);
+
+  // odd sized elements
+  char str[] = "abcde";
+  for(n = 0; gca_itr_sjt(&state, str, 5, 1); n++) {}
+  TASSERT(n == 120);
+  free(state);
+}
+
+void test_comb_itr()
+{
+  status("Testing combination and k-permutation iterators...");
+
+  size_t n, k, i, j, count, *c, *state = NULL;
+  uint64_t mask, prevmask = 0, nck, npk;
+  bool *seen = malloc(1UL << 21), ok;
+
+  for(n = 0; n <= 7; n++) {
+    for(k = 0; k <= n; k++) {
+      for(i = 0, npk = 1; i < k; i++) npk *= n-i;
+      for(i = 1, nck = npk; i <= k; i++) nck /= i;
+
+      // combinations: each subset once, one index out and one in per step
+      memset(seen, 0, 1UL << 21);
+      for(count = 0; (c = gca_itr_comb(&state, n, k)) != NULL; count++) {
+        for(i = 0, mask = 0, ok = true; i < k; i++) {
+          ok = ok && c[i] < n && (!i || c[i] > c[i-1]);
+          mask |= 1UL << (c[i] & 63);
+        }
+        TASSERT(ok && !seen[mask & 0xff]);
+        seen[mask & 0xff] = true;
+        if(count) TASSERT(__builtin_popcountll(mask ^ prevmask) == 2);
+        prevmask = mask;
+      }
+      TASSERT(count == nck);
+      TASSERT(gca_itr_comb(&state, n, k) == NULL);
+      free(state);
+      state = NULL;
+
+      // k-permutations: each ordered selection once
+      memset(seen, 0, 1UL << 21);
+      for(count = 0; (c = gca_itr_kperm(&state, n, k)) != NULL; count++) {
+        for(i = 0, mask = 0, ok = true; i < k; i++) {
+          for(j = 0; j < i; j++) ok = ok && c[i] != c[j];
+          ok = ok && c[i] < n;
+          mask = mask*8 + (c[i] & 7);
+        }
+        TASSERT(ok && !seen[mask]);
+        seen[mask] = true;
+      }
+      TASSERT(count == npk);
+      TASSERT(gca_itr_kperm(&state, n, k) == NULL);
+      free(state);
+      state = NULL;
+    }
+  }
+  free(seen);
+}
+
 void test_next_permutation()
 {
   status("Testing next permutation...");
@@ -714,16 +2556,42 @@ int main()
   test_round();
   test_GCD();
   test_cycle();
+  test_cycle_methods();
+  test_rand();
+  test_reservoir();
+  test_weighted_sampling();
+  test_runmed();
+  test_kll();
+  test_reductions();
+  test_shuffle_mt();
   test_reverse();
   test_bsearch();
   test_quicksort();
   test_quickpartition();
   test_quickselect();
   test_heapsort();
+  test_heapd_sort();
+  test_mmheap();
+  test_pqueue();
+  test_circbuf();
+  test_circbuf_mirror();
+  test_circbuf_shrink();
+  test_circbuf_fd();
+  test_circ_deque();
+  test_circ_window();
+  test_multiqueue();
+  test_spsc();
+  test_mpmc();
   test_median5();
   test_median();
+  test_select_ro();
+  test_set_ops();
+  test_merge_k();
   test_next_permutation();
   test_next_perm_with_dupes();
+  test_perm_rank();
+  test_swap_perms();
+  test_comb_itr();
   status("Passed: %zu / %zu (%s)", num_tests_run-num_tests_failed, num_tests_run,
          !num_tests_failed ? "All" : (num_tests_failed<num_tests_run ? "Some" : "None"));
   status("Done.");